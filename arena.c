@@ -0,0 +1,75 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <stdint.h>
+
+#define ARENA_ALIGN 16
+
+Block* block_new (size_t cap) {
+  Block* block = (Block*)malloc(sizeof(Block) + cap);
+  block->next = NULL;
+  block->cap = cap;
+  block->len = 0;
+  return block;
+}
+
+Arena* arena_new () {
+  return arena_sized(ARENA_BLOCK);
+}
+
+// for many small, long-lived arenas where whole blocks would be wasted
+Arena* arena_sized (size_t block) {
+  Arena* arena = (Arena*)malloc(sizeof(Arena));
+  arena->head = block_new(block);
+  arena->cur = arena->head;
+  arena->allocs = 0;
+  arena->block = block;
+  arena->hcons = NULL;
+  arena->globals = NULL;
+  arena->conv = NULL;
+  return arena;
+}
+
+void arena_delete (Arena* arena) {
+  Block* block = arena->head;
+  while (block) {
+    Block* next = block->next;
+    free(block);
+    block = next;
+  }
+  free(arena);
+}
+
+// releases every allocation at once, blocks are kept for reuse
+void arena_reset (Arena* arena) {
+  arena->cur = arena->head;
+  arena->cur->len = 0;
+  arena->allocs = 0;
+}
+
+void* arena_alloc (Arena* arena, size_t size) {
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  Block* cur = arena->cur;
+
+  while (cur->len + size > cur->cap) {
+    if (!cur->next) {
+      size_t cap = size > arena->block ? size : arena->block;
+      cur->next = block_new(cap);
+    }
+    cur = cur->next;
+    cur->len = 0;
+  }
+
+  void* ptr = cur->data + cur->len;
+  cur->len += size;
+  arena->cur = cur;
+  arena->allocs++;
+  return ptr;
+}
+
+size_t arena_used (Arena* arena) {
+  size_t used = 0;
+  for (Block* block = arena->head; block != arena->cur; block = block->next) {
+    used += block->len;
+  }
+  return used + arena->cur->len;
+}
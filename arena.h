@@ -0,0 +1,46 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+
+// default size of a single arena block
+#define ARENA_BLOCK 65536
+
+typedef struct Block Block;
+typedef struct HashCons HashCons;
+typedef struct Globals Globals;
+typedef struct ConvCache ConvCache;
+
+typedef struct Block {
+  Block* next;
+  size_t cap;
+  size_t len;
+  _Alignas(16) char data[];
+} Block;
+
+//  ______________________________________
+// | head | cur  | ... |  <- blocks are never freed on reset,
+//  --------------------     'cur' rewinds to 'head' and refills
+typedef struct Arena {
+  Block* head;
+  Block* cur;
+  size_t allocs;
+  // size of each new block, larger allocations get a block of their own
+  size_t block;
+  // when set, expression nodes are interned here instead
+  HashCons* hcons;
+  // when set, free names resolve to these declarations
+  Globals* globals;
+  // when set, conversions between its terms are looked up and recorded here
+  ConvCache* conv;
+} Arena;
+
+Arena* arena_new ();
+Arena* arena_sized (size_t block);
+void arena_delete (Arena* arena);
+void arena_reset  (Arena* arena);
+
+void* arena_alloc (Arena* arena, size_t size);
+size_t arena_used (Arena* arena);
+
+#endif
@@ -0,0 +1,180 @@
+#include "batch.h"
+#include "driver.h"
+#include "validate.h"
+#include "pool.h"
+#include "ccache.h"
+#include <string.h>
+
+//  a line from when it is read until its result is written. the item
+//  is reused every BATCH_WINDOW lines along with the memory it holds
+typedef struct BatchItem {
+  char* text;
+  size_t cap;
+  long line;
+  Printer out;
+  int failed;
+  atomic_int done;
+} BatchItem;
+
+//  state confined to one worker, the arena is reset and the caches
+//  and node positions cleared after every line
+typedef struct BatchSlot {
+  Arena* scratch;
+  TypeCache* cache;
+  WhereVec where;
+} BatchSlot;
+
+typedef struct Stream {
+  Globals* globals;
+  BatchItem* items;
+  BatchSlot* slots;
+} Stream;
+
+// 'str' as a JSON string
+static void print_json (Printer* p, const char* str) {
+  print_bytes(p, "\"", 1);
+  for (const char* c = str; *c; c++) {
+    if (*c == '"' || *c == '\\') print_bytes(p, "\\", 1);
+    if ((unsigned char)*c < 0x20) print_fmt(p, "\\u%04x", *c);
+    else print_bytes(p, c, 1);
+  }
+  print_bytes(p, "\"", 1);
+}
+
+//  the result stays in the item's printer, which has no sink. types are
+//  printed flat and their names never need escaping. an error's column
+//  is that of the token its message is about
+static void batch_task (Pool* pool, int worker, int task, void* data) {
+  (void)pool;
+  Stream* stream = data;
+  BatchItem* item = &stream->items[task];
+  BatchSlot* slot = &stream->slots[worker];
+  Arena* arena = slot->scratch;
+  Printer* out = &item->out;
+
+  arena->globals = stream->globals;
+  Tokens toks = tokens_full(item->text, strlen(item->text));
+  Parser* parser = parser_new(arena, &toks);
+  parser_track(parser, &slot->where);
+  Expr* type = NULL;
+  Decl decl;
+  Blame blame;
+  int row, col;
+
+  print_fmt(out, "{\"line\": %ld, ", item->line);
+  if (!parse_decl(parser, &decl)) {
+    const char* mes = parser_message(parser, &row, &col);
+    print_str(out, "\"error\": ");
+    print_json(out, mes);
+    print_fmt(out, ", \"col\": %d}\n", col + 1);
+  }
+  else if (decl.name || !parser_done(parser)) print_str(out, "\"error\": \"expected one expression\"}\n");
+  else if ((type = check_decl_blame(arena, slot->cache, &decl, &blame)) == NULL) {
+    int at = blame.expr ? parser_where(parser, blame.expr) : -1;
+    if (at < 0) print_str(out, "\"error\": \"ill-typed\"}\n");
+    else {
+      tok_pos(&toks, at, &row, &col);
+      print_fmt(out, "\"error\": \"%s\", \"col\": %d}\n", blame.why, col + 1);
+    }
+  }
+  else {
+    print_str(out, "\"type\": \"");
+    print_term(out, type);
+    print_str(out, "\"}\n");
+  }
+  item->failed = type == NULL;
+
+  parser_delete(parser);
+  tokens_free(&toks);
+  WhereVec_clear(&slot->where);
+  if (slot->cache) tcache_clear(slot->cache);
+  if (arena->conv) ccache_clear(arena->conv);
+  arena_reset(arena);
+  arena->globals = NULL;
+  atomic_store_explicit(&item->done, 1, memory_order_release);
+}
+
+//  writes the result of 'item', waiting for it if it is not in yet.
+//  what is buffered goes out first, a reader may be waiting on it
+static int batch_write (Pool* pool, BatchItem* item) {
+  if (!atomic_load_explicit(&item->done, memory_order_acquire)) {
+    fflush(stdout);
+    pool_wait_flag(pool, &item->done);
+  }
+  fwrite(item->out.buf.data, 1, item->out.buf.len, stdout);
+  PrintBuf_clear(&item->out.buf);
+  return item->failed;
+}
+
+//  ___________________________________________________________
+// | read    | the next line into the item it takes in the window |
+// | check   | on any worker, the result into the item           |
+// | write   | the oldest results that are in, in order          |
+//  -----------------------------------------------------------
+//  reading stops while the window is full, so at most BATCH_WINDOW
+//  lines and results are held however far the workers run ahead
+long batch_run (FILE* in, Globals* globals, int workers, size_t cache) {
+  Stream stream;
+  stream.globals = globals;
+  stream.items = malloc(BATCH_WINDOW * sizeof(BatchItem));
+  stream.slots = malloc(workers * sizeof(BatchSlot));
+  for (int i = 0; i < BATCH_WINDOW; i++) {
+    BatchItem* item = &stream.items[i];
+    item->text = NULL;
+    item->cap = 0;
+    printer_init(&item->out, NULL, NULL, 0);
+    atomic_init(&item->done, 0);
+  }
+  for (int i = 0; i < workers; i++) {
+    stream.slots[i].scratch = arena_new();
+    stream.slots[i].cache = cache ? tcache_new(cache) : NULL;
+    WhereVec_init(&stream.slots[i].where, 64);
+    stream.slots[i].scratch->conv = cache ? ccache_new(cache) : NULL;
+  }
+
+  Pool* pool = pool_new(workers, batch_task, &stream);
+  long read = 0;
+  long written = 0;
+  long line = 0;
+  long failed = 0;
+
+  for (;;) {
+    // the item the next line takes is the oldest one in a full window
+    BatchItem* item = &stream.items[read % BATCH_WINDOW];
+    if (read - written == BATCH_WINDOW) failed += batch_write(pool, &stream.items[written++ % BATCH_WINDOW]);
+
+    ssize_t len = getline(&item->text, &item->cap, in);
+    if (len < 0) break;
+    line++;
+
+    while (len > 0 && (item->text[len - 1] == '\n' || item->text[len - 1] == '\r')) item->text[--len] = '\0';
+    if (strspn(item->text, " \t") == (size_t)len) continue;
+
+    item->line = line;
+    atomic_store_explicit(&item->done, 0, memory_order_relaxed);
+    pool_push(pool, read % workers, read % BATCH_WINDOW);
+    read++;
+
+    while (written < read && atomic_load_explicit(&stream.items[written % BATCH_WINDOW].done, memory_order_acquire)) {
+      failed += batch_write(pool, &stream.items[written++ % BATCH_WINDOW]);
+    }
+  }
+
+  while (written < read) failed += batch_write(pool, &stream.items[written++ % BATCH_WINDOW]);
+  fflush(stdout);
+  pool_delete(pool);
+
+  for (int i = 0; i < BATCH_WINDOW; i++) {
+    free(stream.items[i].text);
+    printer_free(&stream.items[i].out);
+  }
+  for (int i = 0; i < workers; i++) {
+    if (stream.slots[i].scratch->conv) ccache_delete(stream.slots[i].scratch->conv);
+    if (stream.slots[i].cache) tcache_delete(stream.slots[i].cache);
+    WhereVec_free(&stream.slots[i].where);
+    arena_delete(stream.slots[i].scratch);
+  }
+  free(stream.items);
+  free(stream.slots);
+  return failed;
+}
@@ -0,0 +1,20 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include "globals.h"
+#include <stdio.h>
+
+// results held for writing in input order, bounds memory however long the stream
+#define BATCH_WINDOW 1024
+
+//  checks each line of 'in' as an expression of its own against
+//  'globals' on 'workers' threads and writes a JSON object per line to
+//  stdout, in input order:
+//    {"line": 1, "type": "(nat->nat)"}
+//    {"line": 2, "error": "argument does not match the domain", "col": 6}
+//    {"line": 3, "error": "expected prefix, found ')'", "col": 4}
+//  lines and columns count from one, blank lines are skipped. returns
+//  the number of lines that failed
+long batch_run (FILE* in, Globals* globals, int workers, size_t cache);
+
+#endif
@@ -0,0 +1,133 @@
+#include "gen.h"
+#include "lexer.h"
+#include "parser.h"
+#include "validate.h"
+#include "nbe.h"
+#include "driver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+// every phase is repeated until it has run for at least this long
+#define BENCH_MS 20.0
+#define BENCH_MIN 64
+
+//  state shared by the phases of one input, parsing keeps its nodes in
+//  'parsed' for the later phases and those build theirs in 'scratch'
+typedef struct Run {
+  const char* src;
+  Tokens tokens;
+  Arena* parsed;
+  Arena* scratch;
+  Expr expr;
+  Expr* out;
+} Run;
+
+typedef void (*PhaseFn) (Run* run);
+
+static void run_lex (Run* run) {
+  tokens_free(&run->tokens);
+  run->tokens = tokenize(run->src);
+}
+
+static void run_parse (Run* run) {
+  arena_reset(run->parsed);
+  parse(run->parsed, &run->tokens, &run->expr);
+}
+
+static void run_check (Run* run) {
+  arena_reset(run->scratch);
+  run->out = check(run->scratch, &run->expr);
+}
+
+static void run_norm (Run* run) {
+  arena_reset(run->scratch);
+  run->out = nbe_normalize(run->scratch, NULL, 0, &run->expr);
+}
+
+// mean milliseconds of one call
+static double time_phase (Run* run, PhaseFn fn) {
+  int reps = 0;
+  double start = clock_ms();
+  double now;
+  do {
+    fn(run);
+    reps++;
+    now = clock_ms();
+  } while (now - start < BENCH_MS);
+  return (now - start) / reps;
+}
+
+static size_t count_nodes (Expr* expr) {
+  return expr ? expr->size : 0;
+}
+
+// peak resident set of the whole process so far
+static double peak_rss_mb () {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;
+}
+
+static void bench_size (const Workload* load, int n) {
+  CharBuf src;
+  CharBuf_init(&src, 256);
+  load->gen(&src, n);
+
+  Run run;
+  run.src = src.data;
+  run.tokens = tokenize(run.src);
+  run.parsed = arena_new();
+  run.scratch = arena_new();
+
+  double lex = time_phase(&run, run_lex);
+  double parse = time_phase(&run, run_parse);
+  size_t parse_allocs = run.parsed->allocs;
+  size_t nodes = count_nodes(&run.expr);
+
+  double check = time_phase(&run, run_check);
+  size_t check_allocs = run.scratch->allocs;
+  int typed = run.out != NULL;
+
+  double norm = time_phase(&run, run_norm);
+  size_t norm_allocs = run.scratch->allocs;
+  size_t normal = count_nodes(run.out);
+  size_t per = load->per_token ? (size_t)tok_count(&run.tokens) : nodes;
+
+  printf("%-8s %6d %8d %8zu %7d | %8.1f | %7.1f %8zu | %7.1f %8zu | %7.1f %8zu %8zu | %7.1f%s%s\n",
+    load->name, n, src.len, nodes, tok_count(&run.tokens),
+    src.len / (lex * 1e3),
+    parse * 1e6 / per, parse_allocs,
+    check * 1e6 / per, check_allocs,
+    norm * 1e6 / per, norm_allocs, normal,
+    peak_rss_mb(), load->per_token ? "  per token" : "", typed ? "" : "  ill-typed");
+
+  tokens_free(&run.tokens);
+  arena_delete(run.parsed);
+  arena_delete(run.scratch);
+  CharBuf_free(&src);
+}
+
+//  bench [max size] [workload], sizes double from BENCH_MIN up to the
+//  lesser of 'max' and the workload's own limit
+int main (int argc, char** argv) {
+  int max = argc > 1 ? atoi(argv[1]) : 4096;
+  const char* only = argc > 2 ? argv[2] : NULL;
+
+  printf("%-8s %6s %8s %8s %7s | %8s | %16s | %16s | %25s | %7s\n",
+    "", "", "", "", "", "lex", "parse", "check", "normalize", "");
+  printf("%-8s %6s %8s %8s %7s | %8s | %7s %8s | %7s %8s | %7s %8s %8s | %7s\n",
+    "workload", "size", "bytes", "nodes", "tokens", "MB/s",
+    "ns/node", "allocs", "ns/node", "allocs", "ns/node", "allocs", "nf nodes", "rss MB");
+
+  for (int i = 0; i < workload_count; i++) {
+    const Workload* load = &workloads[i];
+    if (only && strcmp(only, load->name) != 0) continue;
+    for (int n = BENCH_MIN; n <= max && n <= load->max; n *= 2) {
+      bench_size(load, n);
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,95 @@
+#include "gen.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+
+#define NAT "(forall a:*. (a -> a) -> a -> a)"
+
+void gen_printf (CharBuf* out, const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(NULL, 0, fmt, args);
+  va_end(args);
+
+  // one more for the terminator, which is not counted in 'len'
+  CharBuf_reserve(out, out->len + len + 1);
+  va_start(args, fmt);
+  vsnprintf(out->data + out->len, len + 1, fmt, args);
+  va_end(args);
+  out->len += len;
+}
+
+// \A:*. \x0:A. ... \xn:A. x0
+void gen_lambdas (CharBuf* out, int n) {
+  gen_printf(out, "\\A:*.");
+  for (int i = 0; i < n; i++) gen_printf(out, " \\x%d:A.", i);
+  gen_printf(out, " x0");
+}
+
+// \A:*. \f:A -> ... -> A. \a:A. f a ... a
+void gen_spine (CharBuf* out, int n) {
+  gen_printf(out, "\\A:*. \\f:A");
+  for (int i = 0; i < n; i++) gen_printf(out, " -> A");
+  gen_printf(out, ". \\a:A. f");
+  for (int i = 0; i < n; i++) gen_printf(out, " a");
+}
+
+// \x:(forall a0:*. ... forall an:*. a0). x
+void gen_pis (CharBuf* out, int n) {
+  gen_printf(out, "\\x:(");
+  for (int i = 0; i < n; i++) gen_printf(out, "forall a%d:*. ", i);
+  gen_printf(out, "a0). x");
+}
+
+// \A:*. \x:(A -> ... -> A). x, every arrow binds a dummy
+void gen_arrows (CharBuf* out, int n) {
+  gen_printf(out, "\\A:*. \\x:(A");
+  for (int i = 0; i < n; i++) gen_printf(out, " -> A");
+  gen_printf(out, "). x");
+}
+
+//  \A:*. \x:A. (((... x ...))), depth without width. parentheses make
+//  no nodes, so the term has 7 whatever the depth
+void gen_parens (CharBuf* out, int n) {
+  gen_printf(out, "\\A:*. \\x:A. ");
+  for (int i = 0; i < n; i++) gen_printf(out, "(");
+  gen_printf(out, "x");
+  for (int i = 0; i < n; i++) gen_printf(out, ")");
+}
+
+static void gen_numeral (CharBuf* out, int n) {
+  gen_printf(out, "(\\a:*. \\f:a -> a. \\x:a.");
+  for (int i = 0; i < n; i++) gen_printf(out, " (f");
+  gen_printf(out, " x");
+  for (int i = 0; i < n; i++) gen_printf(out, ")");
+  gen_printf(out, ")");
+}
+
+// add n n, whose normal form is a numeral of 2n
+void gen_church_add (CharBuf* out, int n) {
+  gen_printf(out, "(\\m:" NAT ". \\n:" NAT ". \\a:*. \\f:a -> a. \\x:a. m a f (n a f x)) ");
+  gen_numeral(out, n);
+  gen_printf(out, " ");
+  gen_numeral(out, n);
+}
+
+// mul k k for k = sqrt n, whose normal form is a numeral of about n
+void gen_church_mul (CharBuf* out, int n) {
+  int k = (int)sqrt((double)n);
+  gen_printf(out, "(\\m:" NAT ". \\n:" NAT ". \\a:*. \\f:a -> a. m a (n a f)) ");
+  gen_numeral(out, k);
+  gen_printf(out, " ");
+  gen_numeral(out, k);
+}
+
+const Workload workloads [] = {
+  { "lambdas", gen_lambdas, 1 << 14, 0 },
+  { "spine", gen_spine, 1 << 14, 0 },
+  { "pis", gen_pis, 1 << 14, 0 },
+  { "arrows", gen_arrows, 1 << 14, 0 },
+  { "church+", gen_church_add, 1 << 13, 0 },
+  { "church*", gen_church_mul, 1 << 13, 0 },
+  { "parens", gen_parens, 1 << 20, 1 },
+};
+
+const int workload_count = sizeof(workloads) / sizeof(Workload);
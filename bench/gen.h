@@ -0,0 +1,35 @@
+#ifndef __GEN_H__
+#define __GEN_H__
+
+#include "vec.h"
+
+VEC_DEFINE(CharBuf, char)
+
+//  generators of closed, well-typed terms that grow with 'n' along a
+//  single dimension, each stresses a different shape of input
+typedef void (*GenFn) (CharBuf* out, int n);
+
+typedef struct Workload {
+  const char* name;
+  GenFn gen;
+  // largest size worth timing, several phases are quadratic in it
+  int max;
+  // times are per token rather than per node, for terms whose node
+  // count does not grow with the size
+  int per_token;
+} Workload;
+
+void gen_printf (CharBuf* out, const char* fmt, ...);
+
+void gen_lambdas (CharBuf* out, int n);
+void gen_spine   (CharBuf* out, int n);
+void gen_pis     (CharBuf* out, int n);
+void gen_arrows  (CharBuf* out, int n);
+void gen_church_add (CharBuf* out, int n);
+void gen_church_mul (CharBuf* out, int n);
+void gen_parens  (CharBuf* out, int n);
+
+extern const Workload workloads [];
+extern const int workload_count;
+
+#endif
@@ -0,0 +1,125 @@
+#include "ccache.h"
+#include <stdlib.h>
+#include <string.h>
+
+static inline uint64_t ccache_mix (uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  return x;
+}
+
+ConvCache* ccache_new (size_t cap) {
+  size_t slots = 1;
+  while (slots < cap) slots *= 2;
+
+  ConvCache* cache = (ConvCache*)malloc(sizeof(ConvCache));
+  cache->index = hmap_new();
+  ConvNodeVec_init(&cache->nodes, 64);
+  cache->cap = slots;
+  cache->unequal = calloc(slots, sizeof(ConvPair));
+  cache->hits = 0;
+  cache->misses = 0;
+  cache->rejects = 0;
+  return cache;
+}
+
+void ccache_delete (ConvCache* cache) {
+  hmap_delete(cache->index);
+  ConvNodeVec_free(&cache->nodes);
+  free(cache->unequal);
+  free(cache);
+}
+
+void ccache_clear (ConvCache* cache) {
+  hmap_clear(cache->index);
+  ConvNodeVec_clear(&cache->nodes);
+  memset(cache->unequal, 0, cache->cap * sizeof(ConvPair));
+}
+
+// the node of 'expr', added in a class of its own the first time
+static int ccache_node (ConvCache* cache, Expr* expr) {
+  uint64_t key = (uintptr_t)expr;
+  uint64_t hash = ccache_mix(key);
+  uintptr_t found = (uintptr_t)hmap_get(cache->index, key, hash);
+  if (found) return (int)found - 1;
+
+  int node = cache->nodes.len;
+  ConvNodeVec_push(&cache->nodes, (ConvNode){ expr, node, 0 });
+  hmap_add(cache->index, key, hash, (void*)(uintptr_t)(node + 1));
+  return node;
+}
+
+// path halving, every other node on the way up skips to its grandparent
+static int ccache_find (ConvCache* cache, int node) {
+  ConvNode* nodes = cache->nodes.data;
+  while (nodes[node].parent != node) {
+    nodes[node].parent = nodes[nodes[node].parent].parent;
+    node = nodes[node].parent;
+  }
+  return node;
+}
+
+static ConvPair* ccache_slot (ConvCache* cache, ConvPair pair) {
+  uint64_t key = (uint64_t)(uint32_t)pair.lhs << 32 | (uint32_t)pair.rhs;
+  return &cache->unequal[ccache_mix(key) & (cache->cap - 1)];
+}
+
+// the roots of both classes, ordered so either argument order finds the pair
+static ConvPair ccache_pair (ConvCache* cache, Expr* lhs, Expr* rhs) {
+  int l = ccache_find(cache, ccache_node(cache, lhs)) + 1;
+  int r = ccache_find(cache, ccache_node(cache, rhs)) + 1;
+  return l < r ? (ConvPair){ l, r } : (ConvPair){ r, l };
+}
+
+//  pairs stay in the table after their classes are merged into others,
+//  but only roots are looked up, so those stale pairs are never found
+int ccache_get (ConvCache* cache, Expr* lhs, Expr* rhs) {
+  if (lhs == rhs) {
+    cache->hits++;
+    return 1;
+  }
+
+  ConvPair pair = ccache_pair(cache, lhs, rhs);
+  if (pair.lhs == pair.rhs) {
+    cache->hits++;
+    return 1;
+  }
+
+  ConvPair* slot = ccache_slot(cache, pair);
+  if (slot->lhs == pair.lhs && slot->rhs == pair.rhs) {
+    cache->hits++;
+    return 0;
+  }
+
+  cache->misses++;
+  return -1;
+}
+
+void ccache_put (ConvCache* cache, Expr* lhs, Expr* rhs, int conv) {
+  ConvPair pair = ccache_pair(cache, lhs, rhs);
+  if (!conv) {
+    *ccache_slot(cache, pair) = pair;
+    return;
+  }
+
+  // union by rank, the shallower class hangs off the root of the deeper
+  ConvNode* nodes = cache->nodes.data;
+  ConvNode* l = &nodes[pair.lhs - 1];
+  ConvNode* r = &nodes[pair.rhs - 1];
+  if (l == r) return;
+  if (l->rank < r->rank) l->parent = pair.rhs - 1;
+  else {
+    r->parent = pair.lhs - 1;
+    l->rank += l->rank == r->rank;
+  }
+}
+
+int ccache_alike (ConvCache* cache, Expr* lhs, Expr* rhs) {
+  // interned nodes are unique, so distinct addresses are distinct terms
+  int alike = (lhs->flags & rhs->flags & EXPR_SHARED)
+    ? lhs == rhs
+    : lhs->hash == rhs->hash;
+  cache->rejects += !alike;
+  return alike;
+}
@@ -0,0 +1,50 @@
+#ifndef __CCACHE_H__
+#define __CCACHE_H__
+
+#include "parser.h"
+#include "hashmap.h"
+
+//  a term that took part in a conversion check. 'parent' leads towards
+//  the root of the class of terms proven convertible with it
+typedef struct ConvNode {
+  Expr* expr;
+  int parent;
+  int rank;
+} ConvNode;
+
+VEC_DEFINE(ConvNodeVec, ConvNode)
+
+// roots of two classes proven not convertible, plus one, zero when empty
+typedef struct ConvPair {
+  int lhs;
+  int rhs;
+} ConvPair;
+
+//  memoizes conversions by address. convertible terms are merged into
+//  one class, so a check follows from any chain of earlier ones, while
+//  failures take a slot in a table of 'cap' pairs and are overwritten
+//  as it fills. free indices are rigid in every context, so a result
+//  holds wherever the same two terms meet again. clear it whenever the
+//  arena the terms live in is reset, unless it interns into a HashCons
+typedef struct ConvCache {
+  Hashmap* index;
+  ConvNodeVec nodes;
+  ConvPair* unequal;
+  size_t cap;
+  size_t hits;
+  size_t misses;
+  size_t rejects;
+} ConvCache;
+
+ConvCache* ccache_new (size_t cap);
+void ccache_delete (ConvCache* cache);
+void ccache_clear  (ConvCache* cache);
+
+// 1 when known convertible, 0 when known not to be and -1 otherwise
+int ccache_get  (ConvCache* cache, Expr* lhs, Expr* rhs);
+void ccache_put (ConvCache* cache, Expr* lhs, Expr* rhs, int conv);
+
+// 0 when their structural hashes rule out that the two are equal as written
+int ccache_alike (ConvCache* cache, Expr* lhs, Expr* rhs);
+
+#endif
@@ -0,0 +1,87 @@
+#define _GNU_SOURCE
+#include "deep.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <ucontext.h>
+
+typedef struct Segment {
+  ucontext_t ctx;
+  ucontext_t back;
+  void (*fn) (void*);
+  void* data;
+  char* stack;
+} Segment;
+
+_Thread_local char* deep_floor = NULL;
+
+// the segment being entered, and one kept so that recursion bouncing
+// around a segment boundary does not allocate on every crossing
+static _Thread_local Segment* entering = NULL;
+static _Thread_local Segment* spare = NULL;
+
+//  stacks grow down from the top of the range the thread was given,
+//  if that cannot be found assume a megabyte below the caller is safe
+void deep_init () {
+  pthread_attr_t attr;
+  void* addr = NULL;
+  size_t size = 0;
+
+  if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+    pthread_attr_getstack(&attr, &addr, &size);
+    pthread_attr_destroy(&attr);
+  }
+
+  if (addr && size > DEEP_RESERVE) deep_floor = (char*)addr + DEEP_RESERVE;
+  else deep_floor = (char*)__builtin_frame_address(0) - (1 << 20) + DEEP_RESERVE;
+}
+
+__attribute__((constructor)) static void deep_main () {
+  deep_init();
+}
+
+static void segment_free (Segment* seg) {
+  free(seg->stack);
+  free(seg);
+}
+
+// frees the spare segment, for threads about to exit
+void deep_release () {
+  if (spare) segment_free(spare);
+  spare = NULL;
+}
+
+static void deep_entry () {
+  Segment* seg = entering;
+  seg->fn(seg->data);
+}
+
+//  kept apart so that no local of deep_run lives across getcontext,
+//  which like setjmp may return twice
+__attribute__((noinline)) static void segment_enter (Segment* seg) {
+  getcontext(&seg->ctx);
+  seg->ctx.uc_stack.ss_sp = seg->stack;
+  seg->ctx.uc_stack.ss_size = DEEP_SEGMENT;
+  seg->ctx.uc_link = &seg->back;
+  makecontext(&seg->ctx, deep_entry, 0);
+  swapcontext(&seg->back, &seg->ctx);
+}
+
+void deep_run (void (*fn) (void*), void* data) {
+  Segment* seg = spare;
+  spare = NULL;
+  if (seg == NULL) {
+    seg = malloc(sizeof(Segment));
+    seg->stack = malloc(DEEP_SEGMENT);
+  }
+
+  seg->fn = fn;
+  seg->data = data;
+  char* floor = deep_floor;
+  deep_floor = seg->stack + DEEP_RESERVE;
+  entering = seg;
+  segment_enter(seg);
+  deep_floor = floor;
+
+  if (spare == NULL) spare = seg;
+  else segment_free(seg);
+}
@@ -0,0 +1,29 @@
+#ifndef __DEEP_H__
+#define __DEEP_H__
+
+#include <stddef.h>
+
+//  recursions that follow the nesting of a term check how much of their
+//  stack is left on entry, and once less than DEEP_RESERVE remains they
+//  continue on a fresh segment of DEEP_SEGMENT bytes from the heap. depth
+//  is then bounded by memory, not by the native stack, and a call that
+//  stays shallow pays one compare
+#define DEEP_RESERVE (256 * 1024)
+#define DEEP_SEGMENT (4 * 1024 * 1024)
+
+//  lowest frame address the current stack may reach before switching.
+//  the main thread sets it before main, other threads with deep_init,
+//  one that never does has no floor and never switches
+extern _Thread_local char* deep_floor;
+
+void deep_init ();
+void deep_release ();
+
+// runs 'fn(data)' on a new segment and returns once it does
+void deep_run (void (*fn) (void*), void* data);
+
+static inline int deep_low () {
+  return (char*)__builtin_frame_address(0) < deep_floor;
+}
+
+#endif
@@ -0,0 +1,280 @@
+#include "driver.h"
+#include "validate.h"
+#include "globals.h"
+#include "pool.h"
+#include "stats.h"
+#include "ccache.h"
+#include "printer.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+double clock_ms () {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// lines stay in 'out' until the caller flushes it or it fills up
+void report_decl (Printer* out, Decl* decl, Expr* type, const char* why, double ms) {
+  print_fmt(out, "%-4s %s", type ? "ok" : "fail", decl->name ? sym_name(decl->name) : "_");
+  if (type) {
+    print_str(out, " : ");
+    print_term(out, type);
+  }
+  if (why) print_fmt(out, " (%s)", why);
+  print_fmt(out, "  %.3f ms\n", ms);
+}
+
+int check_decls (Arena* arena, TypeCache* cache, Tokens* tokens, Printer* out) {
+  Globals* globals = arena->globals;
+  Parser* parser = parser_new(arena, tokens);
+  int total = 0;
+  int failed = 0;
+  double start = clock_ms();
+
+  while (!parser_done(parser)) {
+    double begin = clock_ms();
+    const char* why = NULL;
+    Expr* type = NULL;
+    Decl decl;
+
+    STAT_START(parsing);
+    int parsed = parse_decl(parser, &decl);
+    STAT_STOP(TIME_PARSE, parsing);
+
+    if (!parsed) {
+      char error [BUF_LEN];
+      parser_error(parser, error, BUF_LEN);
+      print_fmt(out, "%s\n", error);
+      parser_skip(parser, decl.tok);
+      why = "parse error";
+    } else if (decl.name && globals_find(globals, decl.name)) {
+      why = "already declared";
+    } else {
+      Global* global = decl.name ? globals_declare(globals, decl.name, total) : NULL;
+      type = check_decl(arena, cache, &decl);
+
+      if (type == NULL) why = "ill-typed";
+      else if (global) {
+        Expr* value = decl.value ? expr_clone(globals->arena, decl.value) : NULL;
+        global_define(global, globals->arena, expr_clone(globals->arena, decl.type), value);
+      }
+    }
+
+    total++;
+    failed += type == NULL;
+    report_decl(out, &decl, type, why, clock_ms() - begin);
+
+    // cached types point into the arena unless nodes are interned
+    if (cache && !arena->hcons) tcache_clear(cache);
+    if (arena->conv && !arena->hcons) ccache_clear(arena->conv);
+    arena_reset(arena);
+  }
+
+  print_fmt(out, "%d declarations, %d failed in %.3f ms\n", total, failed, clock_ms() - start);
+  parser_delete(parser);
+  return failed;
+}
+
+VEC_DEFINE(IntVec, int)
+
+//  a declaration waiting on 'pending' of the ones it references,
+//  'dependents' are those waiting on it
+typedef struct Job {
+  Decl decl;
+  Global* global;
+  IntVec dependents;
+  atomic_int pending;
+
+  Expr* type;
+  const char* why;
+  char* error;
+  double ms;
+} Job;
+
+VEC_DEFINE(JobVec, Job)
+
+//  state confined to one worker thread, nodes built while checking go
+//  to 'scratch' and only results that must outlive a job go to 'keep'
+typedef struct Slot {
+  Arena* scratch;
+  Arena* keep;
+  TypeCache* cache;
+} Slot;
+
+typedef struct Batch {
+  Globals* globals;
+  Job* jobs;
+  Slot* slots;
+} Batch;
+
+// records the declarations before 'pos' that 'expr' refers to by name
+void collect_deps (Batch* batch, int pos, int* seen, Expr* expr) {
+  ExprStack todo;
+  ExprStack_init(&todo);
+  ExprStack_push(&todo, expr);
+
+  while (todo.len > 0) {
+    expr = ExprStack_pop(&todo);
+    switch (expr->typ) {
+      case EXP_FREE: {
+        Global* global = globals_find(batch->globals, expr->name);
+        // imported declarations have no job to wait for
+        if (global && global->pos >= 0 && global->pos < pos && seen[global->pos] != pos) {
+          seen[global->pos] = pos;
+          IntVec_push(&batch->jobs[global->pos].dependents, pos);
+          atomic_fetch_add(&batch->jobs[pos].pending, 1);
+        }
+        if (expr->term.ann) ExprStack_push(&todo, expr->term.ann);
+        break;
+      }
+      case EXP_TERM:
+        if (expr->term.ann) ExprStack_push(&todo, expr->term.ann);
+        break;
+      case EXP_SPINE:
+        for (int i = expr->spine.len; i >= 0; i--) ExprStack_push(&todo, expr->spine.nodes[i]);
+        break;
+      case EXP_LAM:
+      case EXP_PI:
+        ExprStack_push(&todo, expr->lam.rhs);
+        ExprStack_push(&todo, expr->lam.lhs);
+        break;
+      default:
+        break;
+    }
+  }
+
+  ExprStack_free(&todo);
+}
+
+//  the checker sees the shared table through a view limited to the
+//  declarations before this one, all of which it depends on are done
+void check_job (Pool* pool, int worker, int task, void* data) {
+  Batch* batch = data;
+  Job* job = &batch->jobs[task];
+  Slot* slot = &batch->slots[worker];
+  double begin = clock_ms();
+
+  if (job->why == NULL) {
+    Globals view = *batch->globals;
+    view.limit = task;
+    slot->scratch->globals = &view;
+    slot->keep->globals = &view;
+
+    Expr* type = check_decl(slot->scratch, slot->cache, &job->decl);
+    if (type == NULL) job->why = "ill-typed";
+    else {
+      job->type = job->decl.type ? job->decl.type : expr_clone(slot->keep, type);
+      if (job->global) global_define(job->global, slot->keep, job->decl.type, job->decl.value);
+    }
+
+    if (slot->cache) tcache_clear(slot->cache);
+    if (slot->scratch->conv) ccache_clear(slot->scratch->conv);
+    arena_reset(slot->scratch);
+    slot->scratch->globals = NULL;
+    slot->keep->globals = NULL;
+  }
+
+  job->ms = clock_ms() - begin;
+  IntVec* next = &job->dependents;
+  for (int i = 0; i < next->len; i++) {
+    if (atomic_fetch_sub(&batch->jobs[next->data[i]].pending, 1) == 1) {
+      pool_push(pool, worker, next->data[i]);
+    }
+  }
+}
+
+int check_decls_parallel (Arena* arena, size_t cache, Tokens* tokens, int workers) {
+  Globals* globals = arena->globals;
+  Parser* parser = parser_new(arena, tokens);
+  double start = clock_ms();
+
+  // parsing and declaring names stays serial, only checking is spread out
+  JobVec jobs;
+  JobVec_init(&jobs, 64);
+  while (!parser_done(parser)) {
+    Job job;
+    memset(&job, 0, sizeof(Job));
+
+    STAT_START(parsing);
+    int parsed = parse_decl(parser, &job.decl);
+    STAT_STOP(TIME_PARSE, parsing);
+
+    if (!parsed) {
+      job.error = arena_alloc(arena, BUF_LEN);
+      parser_error(parser, job.error, BUF_LEN);
+      parser_skip(parser, job.decl.tok);
+      job.why = "parse error";
+    } else if (job.decl.name) {
+      job.global = globals_declare(globals, job.decl.name, jobs.len);
+      if (job.global == NULL) job.why = "already declared";
+    }
+    JobVec_push(&jobs, job);
+  }
+  parser_delete(parser);
+
+  Batch batch;
+  batch.globals = globals;
+  batch.jobs = jobs.data;
+  batch.slots = malloc(workers * sizeof(Slot));
+
+  int* seen = malloc((jobs.len + 1) * sizeof(int));
+  memset(seen, -1, (jobs.len + 1) * sizeof(int));
+  for (int i = 0; i < jobs.len; i++) {
+    Job* job = &jobs.data[i];
+    IntVec_init(&job->dependents, 0);
+    atomic_init(&job->pending, 0);
+  }
+  for (int i = 0; i < jobs.len; i++) {
+    Job* job = &jobs.data[i];
+    if (job->why) continue;
+    if (job->decl.type) collect_deps(&batch, i, seen, job->decl.type);
+    if (job->decl.value) collect_deps(&batch, i, seen, job->decl.value);
+  }
+  free(seen);
+
+  for (int i = 0; i < workers; i++) {
+    batch.slots[i].scratch = arena_new();
+    batch.slots[i].keep = arena_new();
+    batch.slots[i].cache = cache ? tcache_new(cache) : NULL;
+    batch.slots[i].scratch->conv = cache ? ccache_new(cache) : NULL;
+  }
+
+  // roots are gathered before any runs, workers decrement as they go
+  IntVec roots;
+  IntVec_init(&roots, 16);
+  for (int i = 0; i < jobs.len; i++) {
+    if (atomic_load(&jobs.data[i].pending) == 0) IntVec_push(&roots, i);
+  }
+
+  Pool* pool = pool_new(workers, check_job, &batch);
+  for (int i = 0; i < roots.len; i++) pool_push(pool, i, roots.data[i]);
+  pool_wait(pool, jobs.len);
+  pool_delete(pool);
+  IntVec_free(&roots);
+
+  Printer out;
+  printer_init(&out, sink_file, stdout, print_width);
+  int failed = 0;
+  for (int i = 0; i < jobs.len; i++) {
+    Job* job = &jobs.data[i];
+    failed += job->type == NULL;
+    if (job->error) print_fmt(&out, "%s\n", job->error);
+    report_decl(&out, &job->decl, job->type, job->why, job->ms);
+    IntVec_free(&job->dependents);
+  }
+  print_fmt(&out, "%d declarations, %d failed in %.3f ms\n", jobs.len, failed, clock_ms() - start);
+  printer_flush(&out);
+  printer_free(&out);
+
+  for (int i = 0; i < workers; i++) {
+    if (batch.slots[i].scratch->conv) ccache_delete(batch.slots[i].scratch->conv);
+    arena_delete(batch.slots[i].scratch);
+    arena_delete(batch.slots[i].keep);
+    if (batch.slots[i].cache) tcache_delete(batch.slots[i].cache);
+  }
+  free(batch.slots);
+  JobVec_free(&jobs);
+  return failed;
+}
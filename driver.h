@@ -0,0 +1,25 @@
+#ifndef __DRIVER_H__
+#define __DRIVER_H__
+
+#include "parser.h"
+#include "tcache.h"
+#include "printer.h"
+
+//  checks every declaration of 'tokens' in order, each against the ones
+//  that passed before it, and reports one line per declaration to 'out'.
+//  'arena->globals' must be set and 'arena' is reset between declarations.
+//  returns the number of declarations that failed
+int check_decls (Arena* arena, TypeCache* cache, Tokens* tokens, Printer* out);
+
+//  same as 'check_decls' but every declaration is parsed first and then
+//  checked on 'workers' threads as soon as the ones it names are done,
+//  with per-worker caches of 'cache' entries. results print in source
+//  order once all are checked. 'arena' keeps the parsed declarations,
+//  so while a streamed 'tokens' stays within its ring, every one of them
+//  is held until the end rather than one at a time as in 'check_decls'
+int check_decls_parallel (Arena* arena, size_t cache, Tokens* tokens, int workers);
+
+void report_decl (Printer* out, Decl* decl, Expr* type, const char* why, double ms);
+double clock_ms ();
+
+#endif
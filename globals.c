@@ -0,0 +1,72 @@
+#include "globals.h"
+#include "nbe.h"
+#include "object.h"
+#include <limits.h>
+
+Globals* globals_new () {
+  Globals* globals = malloc(sizeof(Globals));
+  globals->arena = arena_new();
+  globals->arena->globals = globals;
+  globals->index = hmap_new();
+  GlobalVec_init(&globals->decls, 16);
+  globals->limit = INT_MAX;
+  globals->base = NULL;
+  globals->libs = NULL;
+  return globals;
+}
+
+void globals_delete (Globals* globals) {
+  arena_delete(globals->arena);
+  hmap_delete(globals->index);
+  GlobalVec_free(&globals->decls);
+  free(globals);
+}
+
+// libraries are searched newest first and stay owned by the caller
+void globals_use (Globals* globals, Object* lib) {
+  lib->next = globals->libs;
+  globals->libs = lib;
+}
+
+// returns NULL when the name is already declared
+Global* globals_declare (Globals* globals, Sym name, int pos) {
+  if (globals_find(globals, name)) return NULL;
+  return globals_add(globals, name, pos);
+}
+
+// declares a name known to be free
+Global* globals_add (Globals* globals, Sym name, int pos) {
+  Global* global = arena_alloc(globals->arena, sizeof(Global));
+  global->name = name;
+  global->pos = pos;
+  global->type = NULL;
+  global->value = NULL;
+  global->val = NULL;
+
+  hmap_add(globals->index, name, sym_hash_of(name), global);
+  GlobalVec_push(&globals->decls, global);
+  return global;
+}
+
+//  marks a declaration as checked, its terms must outlive the table
+//  and its value is evaluated into 'arena'
+void global_define (Global* global, Arena* arena, Expr* type, Expr* value) {
+  global->value = value;
+  global->val = value ? nbe_eval(arena, NULL, value) : NULL;
+  global->type = type;
+}
+
+Global* globals_find (Globals* globals, Sym name) {
+  Global* global = hmap_get(globals->index, name, sym_hash_of(name));
+  if (global == NULL && globals->base) global = globals_find(globals->base, name);
+  for (Object* lib = globals->libs; lib && !global; lib = lib->next) {
+    global = object_import(lib, globals, name);
+  }
+  return global;
+}
+
+Global* globals_get (Globals* globals, Sym name) {
+  Global* global = globals_find(globals, name);
+  if (global == NULL || global->pos >= globals->limit) return NULL;
+  return global->type ? global : NULL;
+}
@@ -0,0 +1,52 @@
+#ifndef __GLOBALS_H__
+#define __GLOBALS_H__
+
+#include "parser.h"
+#include "hashmap.h"
+
+typedef struct Value Value;
+typedef struct Object Object;
+
+//  a top-level declaration at position 'pos' of its file. 'type' stays
+//  NULL until it has been checked and for good if it failed, 'value' is
+//  NULL for an axiom. a definition's value is evaluated once so
+//  references to it unfold without re-evaluating its body
+typedef struct Global {
+  Sym name;
+  int pos;
+  Expr* type;
+  Expr* value;
+  Value* val;
+} Global;
+
+VEC_DEFINE(GlobalVec, Global*)
+
+//  declarations in the order they were added, the first declaration of
+//  a name owns it even if it fails. only declarations before 'limit'
+//  are in scope, which lets concurrent checkers share one table.
+//  names missing from it are looked up in 'base', which is only read,
+//  and then imported from 'libs' at position -1. importing leaves the
+//  table as it is, so lookups may run on any thread once nothing is
+//  being declared
+typedef struct Globals {
+  Arena* arena;
+  Hashmap* index;
+  GlobalVec decls;
+  int limit;
+  Globals* base;
+  Object* libs;
+} Globals;
+
+Globals* globals_new ();
+void globals_delete (Globals* globals);
+
+void globals_use (Globals* globals, Object* lib);
+
+Global* globals_declare (Globals* globals, Sym name, int pos);
+Global* globals_add     (Globals* globals, Sym name, int pos);
+void global_define (Global* global, Arena* arena, Expr* type, Expr* value);
+
+Global* globals_find (Globals* globals, Sym name);
+Global* globals_get  (Globals* globals, Sym name);
+
+#endif
@@ -0,0 +1,135 @@
+#include "hashcons.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define HCONS_INIT 1024
+
+HashCons* hcons_new () {
+  HashCons* hcons = (HashCons*)malloc(sizeof(HashCons));
+  hcons->nodes = arena_new();
+  hcons->cap = HCONS_INIT;
+  hcons->len = 0;
+  hcons->hits = 0;
+  hcons->slots = calloc(hcons->cap, sizeof(Expr*));
+  hcons->hashes = malloc(hcons->cap * sizeof(uint32_t));
+  return hcons;
+}
+
+void hcons_delete (HashCons* hcons) {
+  arena_delete(hcons->nodes);
+  free(hcons->slots);
+  free(hcons->hashes);
+  free(hcons);
+}
+
+uint32_t hcons_mix (uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return (uint32_t)x;
+}
+
+uint32_t hcons_combine (uint32_t seed, uint64_t val) {
+  return seed ^ (hcons_mix(val) + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+Expr* hcons_bind_ann (Expr* expr) {
+  return expr->lam.lhs->term.ann;
+}
+
+uint32_t hcons_hash (Expr* expr) {
+  uint32_t hash = hcons_mix(expr->typ);
+
+  switch (expr->typ) {
+    case EXP_KIND: 
+      return hash;
+    case EXP_FREE: 
+      hash = hcons_combine(hash, expr->name);
+      return hcons_combine(hash, (uintptr_t)expr->term.ann);
+    case EXP_TERM:
+      hash = hcons_combine(hash, expr->term.idx);
+      return hcons_combine(hash, (uintptr_t)expr->term.ann);
+    case EXP_SPINE:
+      hash = hcons_combine(hash, expr->spine.len);
+      for (int i = 0; i <= expr->spine.len; i++) {
+        hash = hcons_combine(hash, (uintptr_t)expr->spine.nodes[i]);
+      }
+      return hash;
+    case EXP_LAM:
+    case EXP_PI:
+      hash = hcons_combine(hash, expr->dep);
+      hash = hcons_combine(hash, (uintptr_t)hcons_bind_ann(expr));
+      return hcons_combine(hash, (uintptr_t)expr->pi.rhs);
+  }
+  return hash;
+}
+
+// shallow comparison, children are compared by address
+int hcons_eq (Expr* lhs, Expr* rhs) {
+  if (lhs->typ != rhs->typ) return 0;
+
+  switch (lhs->typ) {
+    case EXP_KIND: return 1;
+    case EXP_FREE: return lhs->name == rhs->name && lhs->term.ann == rhs->term.ann;
+    case EXP_TERM: return lhs->term.idx == rhs->term.idx && lhs->term.ann == rhs->term.ann;
+    case EXP_SPINE: 
+      return lhs->spine.len == rhs->spine.len &&
+        memcmp(lhs->spine.nodes, rhs->spine.nodes, (lhs->spine.len + 1) * sizeof(Expr*)) == 0;
+    case EXP_LAM:
+    case EXP_PI: return lhs->dep == rhs->dep && hcons_bind_ann(lhs) == hcons_bind_ann(rhs) && lhs->lam.rhs == rhs->lam.rhs;
+  }
+  return 0;
+}
+
+void hcons_grow (HashCons* hcons) {
+  Expr** slots = hcons->slots;
+  uint32_t* hashes = hcons->hashes;
+  size_t cap = hcons->cap;
+
+  hcons->cap *= 2;
+  hcons->slots = calloc(hcons->cap, sizeof(Expr*));
+  hcons->hashes = malloc(hcons->cap * sizeof(uint32_t));
+
+  for (size_t i = 0; i < cap; i++) {
+    if (!slots[i]) continue;
+    size_t slot = hashes[i] & (hcons->cap - 1);
+    while (hcons->slots[slot]) slot = (slot + 1) & (hcons->cap - 1);
+    hcons->slots[slot] = slots[i];
+    hcons->hashes[slot] = hashes[i];
+  }
+
+  free(slots);
+  free(hashes);
+}
+
+Expr* hcons_intern (HashCons* hcons, Expr* expr) {
+  if (2 * (hcons->len + 1) > hcons->cap) hcons_grow(hcons);
+
+  uint32_t hash = hcons_hash(expr);
+  size_t slot = hash & (hcons->cap - 1);
+
+  while (hcons->slots[slot]) {
+    if (hcons->hashes[slot] == hash && hcons_eq(hcons->slots[slot], expr)) {
+      hcons->hits++;
+      return hcons->slots[slot];
+    }
+    slot = (slot + 1) & (hcons->cap - 1);
+  }
+
+  Expr* node = arena_alloc(hcons->nodes, sizeof(Expr));
+  memcpy(node, expr, sizeof(Expr));
+  node->flags |= EXPR_SHARED;
+
+  // the nodes of a spine live as long as the table, not the caller
+  if (expr->typ == EXP_SPINE) {
+    size_t size = (expr->spine.len + 1) * sizeof(Expr*);
+    node->spine.nodes = arena_alloc(hcons->nodes, size);
+    memcpy(node->spine.nodes, expr->spine.nodes, size);
+  }
+  hcons->slots[slot] = node;
+  hcons->hashes[slot] = hash;
+  hcons->len++;
+  return node;
+}
@@ -0,0 +1,26 @@
+#ifndef __HASHCONS_H__
+#define __HASHCONS_H__
+
+#include "parser.h"
+
+//  interning table for expression nodes, children are already
+//  canonical so a node is hashed and compared by its own fields
+//  plus the addresses of its children. binder names never take
+//  part, variables are keyed by their index, so alpha-equivalent
+//  terms share a single node
+typedef struct HashCons {
+  Arena* nodes;
+  Expr** slots;
+  uint32_t* hashes;
+  size_t len;
+  size_t cap;
+  size_t hits;
+} HashCons;
+
+HashCons* hcons_new ();
+void hcons_delete (HashCons* hcons);
+
+Expr* hcons_intern (HashCons* hcons, Expr* expr);
+uint32_t hcons_hash (Expr* expr);
+
+#endif
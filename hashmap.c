@@ -1,152 +1,197 @@
-
 #include "hashmap.h"
+#include "stats.h"
 #include <stdlib.h>
 #include <string.h>
 
-#define FNV_OFFSET 0xcbf29ce484222325 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define FNV_OFFSET 0xcbf29ce484222325
 #define FNV_PRIME  0x00000001b3
 
-Hashmap* hmap_new () {
-  Hashmap* hmap = (Hashmap*)malloc(sizeof(Hashmap));
-  hmap->entries = (Entry**)malloc(HMAP_SIZE * sizeof(Entry*));
-  hmap->hash = fnv1a_hash;
-  hmap->cap = HMAP_SIZE;
-  return hmap;
+// bitmask of the slots in a group whose control byte equals 'ctrl'
+static inline uint32_t group_match (const int8_t* group, int8_t ctrl) {
+#ifdef __SSE2__
+  __m128i bytes = _mm_load_si128((const __m128i*)group);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(ctrl)));
+#else
+  uint32_t mask = 0;
+  for (int i = 0; i < HMAP_GROUP; i++) {
+    if (group[i] == ctrl) mask |= 1u << i;
+  }
+  return mask;
+#endif
 }
 
-void hmap_delete (Hashmap* hmap) {
-  for (size_t i = 0; i < hmap->cap; i++) {
-    Entry *head = hmap->entries[i]->next;
-    hmap_delete_entry(head);
+// bitmask of the empty or deleted slots in a group
+static inline uint32_t group_free (const int8_t* group) {
+#ifdef __SSE2__
+  return _mm_movemask_epi8(_mm_load_si128((const __m128i*)group));
+#else
+  uint32_t mask = 0;
+  for (int i = 0; i < HMAP_GROUP; i++) {
+    if (group[i] < 0) mask |= 1u << i;
   }
+  return mask;
+#endif
+}
 
-  free(hmap->entries);
-  free(hmap);
+// callers may pass weak hashes, spread them over all 64 bits
+static inline uint64_t hmap_mix (uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccd;
+  hash ^= hash >> 33;
+  return hash;
 }
 
-void hmap_delete_entry (Entry*e) {
-  Entry* next = e->next;
-  free(e);
+static inline int8_t hmap_h2 (uint64_t hash) {
+  return (int8_t)(hash >> 57);
+}
+
+Hashmap* hmap_with_cap (size_t cap) {
+  size_t slots = HMAP_INIT;
+  while (slots * 7 < cap * 8) slots *= 2;
 
-  if (next) hmap_delete_entry(next);
+  Hashmap* hmap = (Hashmap*)malloc(sizeof(Hashmap));
+  hmap->ctrl = (int8_t*)aligned_alloc(HMAP_GROUP, slots);
+  hmap->slots = (HSlot*)malloc(slots * sizeof(HSlot));
+  hmap->cap = slots;
+  hmap_clear(hmap);
+  return hmap;
 }
-  
-Entry* hmap_entry_new (char* key, void* value) {
-  Entry *e = (Entry*)malloc(sizeof(Entry));
-  e->key = (char*)malloc(strlen(key) + 1);
-  strcpy(e->key, key);
-  e->value = value;
-  return e;
+
+Hashmap* hmap_new () {
+  return hmap_with_cap(0);
 }
 
-void* hmap_add (Hashmap* hmap, char* key, void* value) {
-  char* cpy = malloc(strlen(key));
-  strcpy(cpy, key);
+void hmap_delete (Hashmap* hmap) {
+  free(hmap->ctrl);
+  free(hmap->slots);
+  free(hmap);
+}
 
-  Entry* e = hmap_entry_new(cpy, value);
-  size_t hash = (hmap->hash)(cpy) % hmap->cap;   
-  Entry* head = hmap->entries[hash];
-  Entry* prev = NULL;
+void hmap_clear (Hashmap* hmap) {
+  memset(hmap->ctrl, CTRL_EMPTY, hmap->cap);
+  hmap->len = 0;
+  hmap->used = 0;
+}
 
-  hmap->len++;
-  
-  if (!head) {
-    hmap->entries[hash] = e;
-    return NULL;
-  } 
-
-  while (1) {  
-    if (strcmp(cpy, head->key) == 0) {
-      if (!prev) {
-         e->next = head->next;
-         hmap->entries[hash] = e;
-      } 
-      else {
-        e->next = head->next;
-        prev->next = e;
-      }
-
-      void* value = head->value;
-      free(head->key);
-      free(head);
-      return value;
+// groups are visited in triangular order, which covers every group
+// when their count is a power of two
+static HSlot* hmap_lookup (Hashmap* hmap, uint64_t key, uint64_t hash) {
+  size_t mask = hmap->cap / HMAP_GROUP - 1;
+  size_t g = (hash >> 7) & mask;
+  int8_t h2 = hmap_h2(hash);
+  STAT_INC(STAT_HMAP_LOOKUPS);
+
+  for (size_t step = 1;; step++) {
+    int8_t* group = hmap->ctrl + g * HMAP_GROUP;
+    STAT_INC(STAT_HMAP_PROBES);
+
+    for (uint32_t match = group_match(group, h2); match; match &= match - 1) {
+      HSlot* slot = &hmap->slots[g * HMAP_GROUP + __builtin_ctz(match)];
+      if (slot->key == key) return slot;
     }
 
-    if (!head->next) break;
-
-    prev = head;
-    head = head->next; 
+    if (group_match(group, CTRL_EMPTY)) return NULL;
+    g = (g + step) & mask;
   }
-
-  head->next = e;
-  return NULL;
 }
 
-void* hmap_rem (Hashmap* hmap, char* key) {
-  size_t hash = (hmap->hash)(key) & hmap->cap;
-  Entry* head = hmap->entries[hash];
-  Entry* prev = NULL;
-
-  hmap->len--;
+// first empty or deleted slot on the probe sequence of 'hash'
+static size_t hmap_free_slot (Hashmap* hmap, uint64_t hash) {
+  size_t mask = hmap->cap / HMAP_GROUP - 1;
+  size_t g = (hash >> 7) & mask;
 
-  if (!head) {
-    return NULL;
+  for (size_t step = 1;; step++) {
+    uint32_t open = group_free(hmap->ctrl + g * HMAP_GROUP);
+    if (open) return g * HMAP_GROUP + __builtin_ctz(open);
+    g = (g + step) & mask;
   }
+}
 
-  while (1) {
-    if (strcmp(key, head->key) == 0) {
-      if (!prev) hmap->entries[hash] = head->next;
-      else prev->next = head->next;
-      
-      void* value = head->value;
-      free(head->key);
-      free(head);
-      return value;
-    }
+static void hmap_place (Hashmap* hmap, uint64_t key, uint64_t hash, void* value) {
+  size_t i = hmap_free_slot(hmap, hash);
+  if (hmap->ctrl[i] == CTRL_EMPTY) hmap->used++;
 
-    if (!head->next) return NULL;
+  hmap->ctrl[i] = hmap_h2(hash);
+  hmap->slots[i].key = key;
+  hmap->slots[i].hash = hash;
+  hmap->slots[i].value = value;
+  hmap->len++;
+}
 
-    prev = head;
-    head = head->next;
+// doubles the table, or only drops tombstones if they make up the load
+static void hmap_resize (Hashmap* hmap) {
+  int8_t* ctrl = hmap->ctrl;
+  HSlot* slots = hmap->slots;
+  size_t cap = hmap->cap;
+
+  if (hmap->len * 16 >= cap * 7) hmap->cap *= 2;
+  hmap->ctrl = (int8_t*)aligned_alloc(HMAP_GROUP, hmap->cap);
+  hmap->slots = (HSlot*)malloc(hmap->cap * sizeof(HSlot));
+  hmap_clear(hmap);
+
+  for (size_t i = 0; i < cap; i++) {
+    if (ctrl[i] >= 0) hmap_place(hmap, slots[i].key, slots[i].hash, slots[i].value);
   }
-}
 
-void* hmap_get (Hashmap* hmap, char* key) {
-  size_t hash = (hmap->hash)(key) % hmap->cap;
-  Entry* head = hmap->entries[hash];
+  free(ctrl);
+  free(slots);
+}
 
-  if (!head) return NULL;
+void* hmap_add (Hashmap* hmap, uint64_t key, uint64_t hash, void* value) {
+  hash = hmap_mix(hash);
+  HSlot* slot = hmap_lookup(hmap, key, hash);
 
-  while(1) {
-    if (strcmp(key, head->key) == 0) return head->value;    
-    if (!head->next) break;
-    head = head->next;
+  if (slot) {
+    void* prev = slot->value;
+    slot->value = value;
+    return prev;
   }
 
+  // keep at least one empty slot in 8 so lookups terminate early
+  if ((hmap->used + 1) * 8 > hmap->cap * 7) hmap_resize(hmap);
+  hmap_place(hmap, key, hash, value);
   return NULL;
 }
 
-int hmap_find (Hashmap* hmap, char* key) {
-  size_t hash = (hmap->hash)(key) % hmap->cap;
-  Entry* head = hmap->entries[hash];
+void* hmap_rem (Hashmap* hmap, uint64_t key, uint64_t hash) {
+  hash = hmap_mix(hash);
+  HSlot* slot = hmap_lookup(hmap, key, hash);
+  if (!slot) return NULL;
+
+  // a group that still has an empty slot never had a probe run past it,
+  // so the slot can be emptied outright instead of left as a tombstone
+  size_t i = slot - hmap->slots;
+  int8_t* group = hmap->ctrl + i / HMAP_GROUP * HMAP_GROUP;
+
+  if (group_match(group, CTRL_EMPTY)) {
+    hmap->ctrl[i] = CTRL_EMPTY;
+    hmap->used--;
+  } else {
+    hmap->ctrl[i] = CTRL_DELETED;
+  }
 
-  if (!head) return 0;
+  hmap->len--;
+  return slot->value;
+}
 
-  while(1) {
-    if (strcmp(key, head->key) == 0) return 1;  
-    if (!head->next) break;
-    head = head->next;
-  }
+void* hmap_get (Hashmap* hmap, uint64_t key, uint64_t hash) {
+  HSlot* slot = hmap_lookup(hmap, key, hmap_mix(hash));
+  return slot ? slot->value : NULL;
+}
 
-  return 0;
+int hmap_find (Hashmap* hmap, uint64_t key, uint64_t hash) {
+  return hmap_lookup(hmap, key, hmap_mix(hash)) != NULL;
 }
 
 size_t fnv1a_hash (char* str) {
   size_t hash = FNV_OFFSET;
   for (char* c = str; *c != '\0'; c++) {
-    hash ^= *c;
+    hash ^= (unsigned char)*c;
     hash *= FNV_PRIME;
   }
-  return 0;
   return hash;
 }
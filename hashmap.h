@@ -2,36 +2,46 @@
 #define _HASHMAP_H_
 
 #include <stddef.h>
+#include <stdint.h>
 #include "vec.h"
 
-// TODO: make this be determined dyamically later
-#define HMAP_SIZE 100
+// slots probed together, one control byte per slot
+#define HMAP_GROUP 16
+#define HMAP_INIT  16
 
-typedef size_t (*hash_fn) (char*);
-typedef struct Entry Entry;
+// a full slot's control byte holds the top 7 bits of its hash
+#define CTRL_EMPTY   ((int8_t)-128)
+#define CTRL_DELETED ((int8_t)-2)
 
-typedef struct Entry {
-  char* key;
+typedef struct HSlot {
+  uint64_t key;
+  uint64_t hash;
   void* value;
-  Entry* next;
-} Entry;
+} HSlot;
 
+//  ________________________________________
+// | ctrl  | h2 | h2 | -- | ~~ | ... (cap)  |  <- probed a group at a time,
+// | slots | kv | kv |    |    | ... (cap)  |     '--' empty, '~~' deleted
+//  ----------------------------------------
 typedef struct {
-  hash_fn hash;
-  Entry** entries;
+  int8_t* ctrl;
+  HSlot* slots;
   size_t len;
+  // live entries plus tombstones, bounds the load factor
+  size_t used;
   size_t cap;
 } Hashmap;
 
 Hashmap* hmap_new ();
-void hmap_delete  (Hashmap* hmap);
-void hmap_delete_entry (Entry* e);
-Entry *hmap_entry_new (char* key, void* value);
-
-void *hmap_add  (Hashmap* hmap, char* key, void* value);
-void *hmap_rem  (Hashmap* hmap, char* key);
-void *hmap_get  (Hashmap* hmap, char* key);
-int hmap_find   (Hashmap* hmap, char* key);
+Hashmap* hmap_with_cap (size_t cap);
+void hmap_delete (Hashmap* hmap);
+void hmap_clear  (Hashmap* hmap);
+
+// keys are stored inline, hashes are supplied by the caller
+void* hmap_add (Hashmap* hmap, uint64_t key, uint64_t hash, void* value);
+void* hmap_rem (Hashmap* hmap, uint64_t key, uint64_t hash);
+void* hmap_get (Hashmap* hmap, uint64_t key, uint64_t hash);
+int hmap_find  (Hashmap* hmap, uint64_t key, uint64_t hash);
 
 size_t fnv1a_hash (char* str);
 
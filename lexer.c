@@ -1,111 +1,305 @@
 #include "lexer.h"
 #include "vec.h"
-#include <ctype.h>
+#include "stats.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <assert.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// the wide scans read whole aligned blocks, which may extend past the
+// terminating NUL but never into the next page
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define LEX_NO_ASAN __attribute__((no_sanitize_address))
+#endif
+#elif defined(__SANITIZE_ADDRESS__)
+#define LEX_NO_ASAN __attribute__((no_sanitize_address))
+#endif
+#ifndef LEX_NO_ASAN
+#define LEX_NO_ASAN
+#endif
+
+//  _________________________________________________
+// | class     | bytes                               |
+// |-------------------------------------------------|
+// | CH_SPACE  | ' ' \t \n \v \f \r                  |
+// | CH_HEAD   | A-Z a-z _                           |
+// | CH_TAIL   | A-Z a-z _ 0-9 '                     |
+// | CH_OP     | \ . : * ( ) -                       |
+// | CH_UTF8   | lead bytes of λ ∀ →                 |
+//  -------------------------------------------------
+#define CH_SPACE 1
+#define CH_HEAD  2
+#define CH_TAIL  4
+#define CH_OP    8
+#define CH_UTF8  16
+
+static const uint8_t char_class [256] = {
+  [' '] = CH_SPACE, ['\t' ... '\r'] = CH_SPACE,
+  ['a' ... 'z'] = CH_HEAD | CH_TAIL,
+  ['A' ... 'Z'] = CH_HEAD | CH_TAIL,
+  ['_'] = CH_HEAD | CH_TAIL,
+  ['0' ... '9'] = CH_TAIL, ['\''] = CH_TAIL,
+  ['\\'] = CH_OP, ['.'] = CH_OP, [':'] = CH_OP, ['*'] = CH_OP,
+  ['('] = CH_OP, [')'] = CH_OP, ['-'] = CH_OP,
+  [0xce] = CH_UTF8, [0xe2] = CH_UTF8,
+};
+
+static const uint8_t char_op [256] = {
+  ['\\'] = TOK_LAM,
+  ['.'] = TOK_PERIOD,
+  [':'] = TOK_COLON,
+  ['*'] = TOK_ASTERISK,
+  ['('] = TOK_LPARENTH,
+  [')'] = TOK_RPARENTH,
+  ['-'] = TOK_ARROW,
+};
+
+//  keywords are few enough for (length + low bits of the first byte)
+//  to be a perfect hash, a hit is confirmed with a single compare
 typedef struct {
-  VEC(Token) tokens;
-  const char* stream;
-  const char* ptr;
-  int row;
-  int col;
-  int bind_site;
-} Lexer;
-
-Token new_token (Lexer* state, TokenType type, const char* tok) {
-  Token token;
-  token.type = type;
-  token.col = state->col;
-  token.row = state->row;
-  strcpy(token.tok, tok);
-  return token;
-}
-
-void add_token (Lexer* state, const char* lex, TokenType type) {
-  Token token = new_token(state, type, lex);
-  state->col += strlen(lex);
-  VEC_PUSH(state->tokens, token);
-}
-
-int take (Lexer* state, const char* pat, TokenType type) {
-  if (strncmp(state->ptr, pat, strlen(pat)) == 0) {
-    add_token(state, pat, type);
-    state->ptr += strlen(pat);
-    return 1;
+  const char* text;
+  int len;
+  TokenType type;
+} Keyword;
+
+#define KW_SLOT(C, N) (((N) + ((C) & 7)) & 7)
+
+static const Keyword keywords [8] = {
+  [KW_SLOT('f', 6)] = { "forall", 6, TOK_FORALL },
+  [KW_SLOT('d', 3)] = { "def", 3, TOK_DEF },
+  [KW_SLOT('a', 5)] = { "axiom", 5, TOK_AXIOM },
+};
+
+static int keyword (const char* str, int len, TokenType* type) {
+  const Keyword* kw = &keywords[KW_SLOT(str[0], len)];
+  if (kw->len != len || memcmp(kw->text, str, len) != 0) return 0;
+  *type = kw->type;
+  return 1;
+}
+
+void add_token (Tokens* state, TokenType type, int len, uint32_t hash) {
+  uint32_t slot = state->count & state->mask;
+
+  if ((int)slot == state->types.cap) {
+    ByteVec_reserve(&state->types, slot + 1);
+    SpanVec_reserve(&state->spans, slot + 1);
+    HashVec_reserve(&state->hashes, slot + 1);
   }
 
-  return 0;
+  state->types.data[slot] = type;
+  state->spans.data[slot].off = state->cur - state->src;
+  state->spans.data[slot].len = len;
+  state->hashes.data[slot] = hash;
+  state->count++;
+  state->cur += len;
+  STAT_INC(STAT_TOKENS);
+}
+
+#ifdef __SSE2__
+// one bit per byte of the aligned block at 'p' that is whitespace
+static inline uint32_t space_mask (__m128i bytes) {
+  __m128i ctl = _mm_sub_epi8(bytes, _mm_set1_epi8('\t'));
+  __m128i is_ctl = _mm_cmpeq_epi8(_mm_min_epu8(ctl, _mm_set1_epi8(4)), ctl);
+  __m128i is_sp = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+  return _mm_movemask_epi8(_mm_or_si128(is_ctl, is_sp));
 }
 
-void take_space (Lexer* state) {
-  while (isspace(*state->ptr)) {
-    state->col++;
-    state->ptr++; 
-    if (*state->ptr == '\n') {
-      state->row++;
-      state->col = 0;
-    }   
+// one bit per byte that may continue an identifier
+static inline uint32_t tail_mask (__m128i bytes) {
+  __m128i alpha = _mm_sub_epi8(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+  __m128i digit = _mm_sub_epi8(bytes, _mm_set1_epi8('0'));
+  __m128i is_alpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(25)), alpha);
+  __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+  __m128i is_sym = _mm_or_si128(
+    _mm_cmpeq_epi8(bytes, _mm_set1_epi8('_')),
+    _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\'')));
+  return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(is_alpha, is_digit), is_sym));
+}
+#endif
+
+//  first byte from 'p' on outside of 'cls', scanned an aligned block at a time.
+//  the NUL terminator belongs to no class, so the scan always stops
+LEX_NO_ASAN static const char* skip_class (const char* p, uint8_t cls) {
+#ifdef __SSE2__
+  const char* block = (const char*)((uintptr_t)p & ~(uintptr_t)15);
+  uint32_t skip = p - block;
+
+  for (;;) {
+    __m128i bytes = _mm_load_si128((const __m128i*)block);
+    uint32_t in = cls == CH_SPACE ? space_mask(bytes) : tail_mask(bytes);
+    uint32_t out = ~in & (0xffffu << skip) & 0xffff;
+    if (out) return block + __builtin_ctz(out);
+    block += 16;
+    skip = 0;
   }
+#else
+  while (char_class[(uint8_t)*p] & cls) p++;
+  return p;
+#endif
 }
 
-int take_op (Lexer* state) {
-  if (take(state, "\\", TOK_LAM) || take(state, "forall", TOK_FORALL)) {
-    state->bind_site = 1;
-    return 1;
-  } 
+void take_ident (Tokens* state) {
+  const char* end = skip_class(state->cur + 1, CH_TAIL);
+  int len = end - state->cur;
 
-  if (take(state, ".", TOK_PERIOD)) {
-    state->bind_site = 0;
-    return 1;
+  TokenType type;
+  if (keyword(state->cur, len, &type)) {
+    add_token(state, type, len, 0);
+    return;
   }
 
-  return 
-    take(state, ":", TOK_COLON)    ||
-    take(state, "->", TOK_ARROW)   ||
-    take(state, "*", TOK_ASTERISK) ||
-    take(state, "(", TOK_LPARENTH) ||
-    take(state, ")", TOK_RPARENTH);
+  uint32_t hash = SYM_HASH_INIT;
+  for (const char* c = state->cur; c != end; c++) {
+    hash = SYM_HASH_STEP(hash, *c);
+  }
+  add_token(state, TOK_IDENT, len, hash);
 }
 
-int take_ident (Lexer* state) {
-  char lex [BUF_LEN] = {0};
-  char* ptr = lex;
+void take_op (Tokens* state) {
+  TokenType type = char_op[(uint8_t)*state->cur];
 
-  while (isalpha(*state->ptr) && islower(*state->ptr)) {
-    *ptr = *state->ptr;
-    state->ptr++;
-    ptr++;
+  if (type == TOK_ARROW) {
+    if (state->cur[1] == '>') add_token(state, TOK_ARROW, 2, 0);
+    else add_token(state, TOK_ERROR, 1, 0);
+    return;
   }
 
-  if (ptr != lex) {
-    add_token(state, lex, TOK_IDENT);
-    return 1;
+  if (type == TOK_COLON && state->cur[1] == '=') {
+    add_token(state, TOK_DEFINE, 2, 0);
+    return;
   }
 
-  return 0;
+  add_token(state, type, 1, 0);
+}
+
+// λ is CE BB, ∀ is E2 88 80 and → is E2 86 92
+void take_utf8 (Tokens* state) {
+  const uint8_t* c = (const uint8_t*)state->cur;
+
+  if (c[0] == 0xce && c[1] == 0xbb) add_token(state, TOK_LAM, 2, 0);
+  else if (c[0] == 0xe2 && c[1] == 0x88 && c[2] == 0x80) add_token(state, TOK_FORALL, 3, 0);
+  else if (c[0] == 0xe2 && c[1] == 0x86 && c[2] == 0x92) add_token(state, TOK_ARROW, 3, 0);
+  else add_token(state, TOK_ERROR, 1, 0);
+}
+
+// unknown input becomes a single error token spanning one code point
+void take_error (Tokens* state) {
+  int len = 1;
+  while ((state->cur[len] & 0xc0) == 0x80) len++;
+  add_token(state, TOK_ERROR, len, 0);
 }
 
-VEC(Token) tokenize (const char* stream) {
-  Lexer lex;
-  lex.tokens = VEC_NEW(Token, 2);
-  lex.stream = stream;
-  lex.ptr = stream;
-  lex.row = 0;
-  lex.col = 0;
-  lex.bind_site = 0;
+// lexes a single token, the end of input is marked by the terminator
+void lex_next (Tokens* state) {
+  state->cur = skip_class(state->cur, CH_SPACE);
+  uint8_t cls = char_class[(uint8_t)*state->cur];
 
-  while (*lex.ptr != '\0') {
-    do { 
-      take_space(&lex); 
-    } while (take_op(&lex));
-    take_ident(&lex);
+  if (cls & CH_HEAD) take_ident(state);
+  else if (cls & CH_OP) take_op(state);
+  else if (cls & CH_UTF8) take_utf8(state);
+  else if (state->cur >= state->end) {
+    add_token(state, TOK_END_OF_INPUT, 0, 0);
+    state->done = 1;
   }
+  else take_error(state);
+}
+
+Tokens tokens_new (const char* src, size_t len, uint32_t mask, int cap) {
+  Tokens tokens;
+  tokens.src = src;
+  tokens.end = src + len;
+  tokens.cur = src;
+  ByteVec_init(&tokens.types, cap);
+  SpanVec_init(&tokens.spans, cap);
+  HashVec_init(&tokens.hashes, cap);
+  tokens.mask = mask;
+  tokens.count = 0;
+  tokens.done = 0;
+  tokens.pos_off = 0;
+  tokens.pos_row = 0;
+  return tokens;
+}
+
+Tokens tokenize (const char* stream) {
+  return tokens_full(stream, strlen(stream));
+}
+
+Tokens tokens_full (const char* src, size_t len) {
+  // roughly one token per couple of source bytes
+  Tokens tokens = tokens_new(src, len, TOK_ALL, len / 2 + 16);
+  STAT_START(start);
+  while (!tokens.done) lex_next(&tokens);
+  STAT_STOP(TIME_LEX, start);
+  return tokens;
+}
+
+Tokens tokens_stream (const char* src, size_t len) {
+  return tokens_new(src, len, TOK_RING - 1, TOK_RING);
+}
+
+//  streamed tokens are lexed once the parser reaches them, those
+//  more than TOK_RING behind the newest one are overwritten
+void tok_fill (Tokens* tokens, int idx) {
+  STAT_START(start);
+  while (!tokens->done && tokens->count <= idx) lex_next(tokens);
+  STAT_STOP(TIME_LEX, start);
+}
+
+void tokens_free (Tokens* tokens) {
+  ByteVec_free(&tokens->types);
+  SpanVec_free(&tokens->spans);
+  HashVec_free(&tokens->hashes);
+}
+
+int tok_count (Tokens* tokens) {
+  return tokens->count;
+}
+
+//  the slot of token 'idx', lexing up to it first. a streamed token
+//  older than the ring holds would read whatever replaced it
+static inline uint32_t tok_slot (Tokens* tokens, int idx) {
+  if (idx >= tokens->count) tok_fill(tokens, idx);
+  assert(idx < tokens->count);
+  assert(tokens->mask == TOK_ALL || idx + TOK_RING >= tokens->count);
+  return idx & tokens->mask;
+}
+
+TokenType tok_type (Tokens* tokens, int idx) {
+  return tokens->types.data[tok_slot(tokens, idx)];
+}
+
+Span tok_span (Tokens* tokens, int idx) {
+  return tokens->spans.data[tok_slot(tokens, idx)];
+}
+
+uint32_t tok_hash (Tokens* tokens, int idx) {
+  return tokens->hashes.data[tok_slot(tokens, idx)];
+}
+
+const char* tok_text (Tokens* tokens, int idx) {
+  return tokens->src + tok_span(tokens, idx).off;
+}
+
+//  rows and columns are only needed for diagnostics, so recover them
+//  lazily. rows are counted on from the last position asked for, which
+//  for errors reported in source order adds up to a single pass
+void tok_pos (Tokens* tokens, int idx, int* row, int* col) {
+  const char* src = tokens->src;
+  uint32_t off = tok_span(tokens, idx).off;
+
+  for (uint32_t i = tokens->pos_off; i < off; i++) tokens->pos_row += src[i] == '\n';
+  for (uint32_t i = off; i < tokens->pos_off; i++) tokens->pos_row -= src[i] == '\n';
+  tokens->pos_off = off;
 
-  Token end = new_token(&lex, TOK_END_OF_INPUT, "");
-  VEC_PUSH(lex.tokens, end);
-  return lex.tokens;
+  uint32_t start = off;
+  while (start > 0 && src[start - 1] != '\n') start--;
+  *row = tokens->pos_row;
+  *col = off - start;
 }
 
 const char* tok (TokenType type) {
@@ -120,6 +314,11 @@ const char* tok (TokenType type) {
     case TOK_FORALL: return "∀";
     case TOK_LPARENTH: return "(";
     case TOK_RPARENTH: return ")";
+    case TOK_DEF: return "def";
+    case TOK_AXIOM: return "axiom";
+    case TOK_DEFINE: return ":=";
+    case TOK_ERROR: return "unknown character";
     case TOK_END_OF_INPUT: return "end of input";
   }
+  return "";
 }
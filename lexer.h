@@ -2,6 +2,7 @@
 #define __LEXER_H__
 
 #include "common.h"
+#include "symtab.h"
 
 typedef enum {
   TOK_IDENT,
@@ -14,24 +15,59 @@ typedef enum {
   TOK_ASTERISK,
   TOK_LPARENTH,
   TOK_RPARENTH,
+  TOK_DEF,
+  TOK_AXIOM,
+  TOK_DEFINE,
+  TOK_ERROR,
   TOK_END_OF_INPUT,
 } TokenType;
 
+// lexeme location as a byte range of the source buffer
 typedef struct {
-  TokenType type;
-  char tok[BUF_LEN];
-  int  row;
-  int  col;
-} Token;
+  uint32_t off;
+  uint32_t len;
+} Span;
+
+VEC_DEFINE(ByteVec, uint8_t)
+VEC_DEFINE(SpanVec, Span)
+VEC_DEFINE(HashVec, uint32_t)
+
+// tokens kept by a streaming lexer, must be a power of two
+#define TOK_RING 64
+#define TOK_ALL  UINT32_MAX
 
+//  structure of arrays, token 'i' is described by types[i & mask],
+//  spans[i & mask] and, for identifiers, hashes[i & mask].
+//  'tokenize' and 'tokens_full' lex the whole source up front and keep
+//  every token, 'tokens_stream' lexes on demand into a ring of the last
+//  TOK_RING, reading one further back than that is an error
 typedef struct {
-  int beg_row;
-  int beg_col;
-  int end_row;
-  int end_col;
-} Span;
+  const char* src;
+  const char* end;
+  const char* cur;
+  ByteVec types;
+  SpanVec spans;
+  HashVec hashes;
+  uint32_t mask;
+  int count;
+  int done;
+  // offset and row of the last position asked for, see 'tok_pos'
+  uint32_t pos_off;
+  int pos_row;
+} Tokens;
+
+Tokens tokenize (const char* stream);
+// 'src[len]' must be a readable NUL, as with 'source_map'
+Tokens tokens_full (const char* src, size_t len);
+Tokens tokens_stream (const char* src, size_t len);
+void tokens_free (Tokens* tokens);
 
-VEC(Token) tokenize (const char* stream);
+int tok_count (Tokens* tokens);
+TokenType tok_type (Tokens* tokens, int idx);
+Span tok_span (Tokens* tokens, int idx);
+uint32_t tok_hash (Tokens* tokens, int idx);
+const char* tok_text (Tokens* tokens, int idx);
+void tok_pos (Tokens* tokens, int idx, int* row, int* col);
 
 const char* tok (TokenType type);
 
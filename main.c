@@ -3,33 +3,161 @@
 #include "lexer.h"
 #include "parser.h"
 #include "validate.h"
+#include "arena.h"
+#include "hashcons.h"
+#include "source.h"
+#include "globals.h"
+#include "driver.h"
+#include "pool.h"
+#include "session.h"
+#include "object.h"
+#include "stats.h"
+#include "ccache.h"
+#include "printer.h"
+#include "server.h"
+#include "batch.h"
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/stat.h>
 
-Expr test (const char* tex) {
-  VEC(Token) toks = tokenize(tex);
-  for (int i = 0; i < VEC_LEN(toks); i++) {
-    printf("(%d) - %s\n", i, tok(toks[i].type));
-  }
+// how often a watched file is polled for changes
+#define WATCH_MS 200
 
+Expr* run (Arena* arena, Arena* keep, TypeCache* cache, Tokens* toks) {
   Expr expr;
 
-  if (!parse(toks, &expr)) {
+  if (!parse(arena, toks, &expr)) {
     printf("failed to parse\n");
+    arena_reset(arena);
+    return NULL;
   }
 
   print_expr(&expr);
   printf("\n");
 
-  Expr* type = check(&expr);
+  Expr* type = check_with(arena, cache, &expr);
 
   if (type != NULL) {
     print_expr(type);
     printf("\n");
+    type = expr_clone(keep, type);
+  }
+
+  if (cache && !arena->hcons) tcache_clear(cache);
+  if (arena->conv && !arena->hcons) ccache_clear(arena->conv);
+  arena_reset(arena);
+  return type;
+}
+
+Expr* test (Arena* arena, Arena* keep, TypeCache* cache, const char* tex) {
+  Tokens toks = tokenize(tex);
+  for (int i = 0; i < tok_count(&toks); i++) {
+    printf("(%d) - %s\n", i, tok(tok_type(&toks, i)));
+  }
+
+  Expr* type = run(arena, keep, cache, &toks);
+  tokens_free(&toks);
+  return type;
+}
+
+//  the file is mapped and lexed as the parser pulls tokens, its
+//  declarations are checked in this one process, in order or spread
+//  over 'jobs' threads. in order each parsed declaration is dropped
+//  once checked, spread out all are parsed before any is checked.
+//  'arena->globals' must be set
+int test_file (Arena* arena, TypeCache* cache, int cached, int jobs, const char* path) {
+  Source src;
+  if (!source_map(path, &src)) return 1;
+
+  Tokens toks = tokens_stream(src.data, src.len);
+  Printer out;
+  printer_init(&out, sink_file, stdout, print_width);
+  int failed = jobs > 1 
+    ? check_decls_parallel(arena, cached, &toks, jobs)
+    : check_decls(arena, cache, &toks, &out);
+  printer_flush(&out);
+  printer_free(&out);
+  tokens_free(&toks);
+  source_unmap(&src);
+  return failed;
+}
+
+
+
+static volatile sig_atomic_t watching = 1;
+
+static void stop_watch (int sig) {
+  (void)sig;
+  watching = 0;
+}
+
+//  re-checks the file each time its size or modification time changes,
+//  keeping whatever an edit left untouched, until interrupted
+int watch_file (const char* path, Globals* globals, size_t cache) {
+  Session* session = session_new(globals, cache);
+  struct timespec poll = { 0, WATCH_MS * 1000000L };
+  struct stat last;
+  memset(&last, 0, sizeof(last));
+  int failed = 0;
+
+  signal(SIGINT, stop_watch);
+  while (watching) {
+    struct stat st;
+    int changed = stat(path, &st) == 0 && (
+      st.st_size != last.st_size ||
+      st.st_mtim.tv_sec != last.st_mtim.tv_sec ||
+      st.st_mtim.tv_nsec != last.st_mtim.tv_nsec);
+
+    Source src;
+    if (changed && source_map(path, &src)) {
+      last = st;
+      failed = session_update(session, src.data, src.len);
+      source_unmap(&src);
+      fflush(stdout);
+    }
+    nanosleep(&poll, NULL);
   }
 
-  return expr;
+  session_delete(session);
+  return failed;
 }
 
+//  asks a running server instead of checking here. it has its own
+//  working directory, so a file goes by its absolute path, and an
+//  expression has its type inferred
+int send_request (const char* server, const char* path, const char* src) {
+  char* full = path ? realpath(path, NULL) : NULL;
+  const char* arg = path ? (full ? full : path) : src;
+  size_t len = strlen(arg) + 16;
+  char* request = malloc(len);
+  snprintf(request, len, "%s %s", path ? "file" : "infer", arg);
 
+  // a request is one line
+  for (char* c = request; *c; c++) {
+    if (*c == '\n' || *c == '\r') *c = ' ';
+  }
+
+  int failed = server_send(server, request);
+  free(request);
+  free(full);
+  return failed != 0;
+}
+
+//  checks a stream of expressions, one per line, from 'path' or from
+//  stdin for '-'. stdout then carries nothing but results
+int test_batch (Globals* globals, int cached, int jobs, const char* path) {
+  FILE* in = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+  if (in == NULL) {
+    fprintf(stderr, "cannot open '%s'\n", path);
+    return 1;
+  }
+
+  long failed = batch_run(in, globals, jobs, cached);
+  if (in != stdin) fclose(in);
+  return failed != 0;
+}
 
 int main (int argc, char** argv) {
   //Expr r1 = term("\\x.x y z");
@@ -38,17 +166,110 @@ int main (int argc, char** argv) {
   //printf("eq: %b\n", expr_eq(&r1, &r2));
   //check();
   
-  if (argc != 2) {
+  const char* src = NULL;
+  const char* path = NULL;
+  const char* watch = NULL;
+  const char* serve = NULL;
+  const char* batch = NULL;
+  // a running server to send the request to instead
+  const char* server = getenv("LAMBDA_SERVER");
+  int share = 0;
+  int cached = 0;
+  int jobs = 1;
+  // -1 for no report, else whether it is JSON
+  int stats = -1;
+  const char** lib_paths = malloc(argc * sizeof(const char*));
+  int nlibs = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--share") == 0) share = 1;
+    else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) cached = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) path = argv[++i];
+    else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) jobs = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) print_width = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--watch") == 0 && i + 1 < argc) watch = argv[++i];
+    else if (strcmp(argv[i], "--stats") == 0) stats = 0;
+    else if (strcmp(argv[i], "--stats=json") == 0) stats = 1;
+    else if (strcmp(argv[i], "--lib") == 0 && i + 1 < argc) lib_paths[nlibs++] = argv[++i];
+    else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) serve = argv[++i];
+    else if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc) server = argv[++i];
+    else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) batch = argv[++i];
+    else src = argv[i];
+  }
+
+  // a session resets the arenas it checks in, hash-consing would not survive it
+  if (watch && share) {
+    printf("--watch cannot be combined with --share\n");
+    return 1;
+  }
+
+  if (src == NULL && path == NULL && watch == NULL && serve == NULL && batch == NULL) {
     printf("expected an argument!\n");
     return 1;
   }
 
-  Expr a = test(argv[1]);
+  // the server's libraries are the ones it was started with
+  if (server && serve == NULL && batch == NULL && watch == NULL) {
+    free(lib_paths);
+    return send_request(server, path, src);
+  }
+
+  // anything but results goes to stderr in batch mode
+  FILE* log = batch ? stderr : stdout;
+  Object** libs = malloc(argc * sizeof(Object*));
+  for (int i = 0; i < nlibs; i++) {
+    double start = clock_ms();
+    libs[i] = library_open(lib_paths[i], log);
+    if (libs[i] == NULL) return 1;
+    fprintf(log, "loaded '%s', %u declarations in %.3f ms\n", lib_paths[i], libs[i]->header->ndecls, clock_ms() - start);
+  }
+  free(lib_paths);
+
+  Arena* arena = arena_new();
+  Arena* keep = arena_new();
+
+  // intern every node so structurally equal terms are pointer equal
+  if (share) arena->hcons = hcons_new();
+  // a server, batch or session keeps caches of its own
+  int own = cached > 0 && !serve && !batch && !watch;
+  TypeCache* cache = own ? tcache_new(cached) : NULL;
+  if (own) arena->conv = ccache_new(cached);
+
+  // later libraries are searched first
+  Globals* globals = globals_new();
+  for (int i = 0; i < nlibs; i++) globals_use(globals, libs[i]);
+  arena->globals = globals;
+
+  int failed = 0;
+  // zero jobs means one per core
+  if (jobs <= 0) jobs = pool_cores();
+  if (watch) failed = watch_file(watch, globals, cached);
+  else if (serve) failed = server_run(serve, globals, jobs, cached);
+  else if (batch) failed = test_batch(globals, cached, jobs, batch);
+  else if (path) failed = test_file(arena, cache, cached, jobs, path);
+  else test(arena, keep, cache, src);
+
+  if (cache) {
+    printf("cache: %zu hits, %zu misses, %zu evictions\n", cache->hits, cache->misses, cache->evictions);
+    tcache_delete(cache);
+  }
+  if (arena->conv) {
+    ConvCache* conv = arena->conv;
+    printf("conv: %zu hits, %zu misses, %zu rejected\n", conv->hits, conv->misses, conv->rejects);
+    ccache_delete(conv);
+  }
+  if (stats >= 0) stats_report(log, stats);
   //Expr b = test(argv[2]);
 
   //int pass = expr_eq(&a, &b);
 
   //printf("eq: %d\n", pass);
 
-  return 0;
+  if (arena->hcons) hcons_delete(arena->hcons);
+  arena_delete(arena);
+  arena_delete(keep);
+  globals_delete(globals);
+  for (int i = 0; i < nlibs; i++) object_close(libs[i]);
+  free(libs);
+  return failed != 0;
 }
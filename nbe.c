@@ -0,0 +1,307 @@
+#include "nbe.h"
+#include "validate.h"
+#include "globals.h"
+#include "stats.h"
+#include "deep.h"
+#include "ccache.h"
+#include <string.h>
+
+Value* val_new (Arena* arena, ValueType typ) {
+  Value* val = arena_alloc(arena, sizeof(Value));
+  memset(val, 0, sizeof(Value));
+  val->typ = typ;
+  return val;
+}
+
+Value* nbe_var (Arena* arena, int level, Sym name) {
+  Value* val = val_new(arena, VAL_NEU);
+  val->name = name;
+  val->neu.head = HEAD_VAR;
+  val->neu.level = level;
+  return val;
+}
+
+static int env_len (Env* env) {
+  return env ? env->len : 0;
+}
+
+//  two jumps of the same length merge into one spanning both and the
+//  entry itself, otherwise the jump only skips the entry below
+Env* env_push (Arena* arena, Env* env, Value* val) {
+  Env* ext = arena_alloc(arena, sizeof(Env));
+  ext->val = val;
+  ext->next = env;
+  ext->jump = env;
+  ext->len = env_len(env) + 1;
+  if (env && env->jump && env->len - env->jump->len == env->jump->len - env_len(env->jump->jump)) {
+    ext->jump = env->jump->jump;
+  }
+  return ext;
+}
+
+//  an index past the end of the environment is a variable the caller
+//  did not provide, it gets a negative level that no binder can take
+Value* env_get (Arena* arena, Env* env, Expr* var) {
+  int idx = var->term.idx;
+  int len = env_len(env);
+  if (idx >= len) return nbe_var(arena, -1 - (idx - len), var->name);
+
+  int want = len - idx;
+  while (env->len > want) {
+    env = env_len(env->jump) >= want ? env->jump : env->next;
+  }
+  return env->val;
+}
+
+Closure closure_new (Env* env, Expr* body) {
+  Closure closure;
+  closure.env = env;
+  closure.body = body;
+  return closure;
+}
+
+//  evaluation, read back and conversion follow the nesting of the term
+//  and move to a heap segment when the stack runs low, see deep.h
+typedef struct NbeCall {
+  Arena* arena;
+  Env* env;
+  int depth;
+  Expr* expr;
+  Value* lhs;
+  Value* rhs;
+  union {
+    Value* val;
+    Expr* res;
+    int conv;
+  };
+} NbeCall;
+
+static void eval_deep (void* data) {
+  NbeCall* call = data;
+  call->val = nbe_eval(call->arena, call->env, call->expr);
+}
+
+static void quote_deep (void* data) {
+  NbeCall* call = data;
+  call->res = nbe_quote(call->arena, call->depth, call->lhs);
+}
+
+static void conv_deep (void* data) {
+  NbeCall* call = data;
+  call->conv = nbe_conv_val(call->arena, call->depth, call->lhs, call->rhs);
+}
+
+Value* nbe_eval (Arena* arena, Env* env, Expr* expr) {
+  if (deep_low()) {
+    NbeCall call = { .arena = arena, .env = env, .expr = expr };
+    deep_run(eval_deep, &call);
+    return call.val;
+  }
+
+  switch (expr->typ) {
+    case EXP_KIND: 
+      return val_new(arena, VAL_KIND);
+    case EXP_TERM: 
+      return env_get(arena, env, expr);
+    case EXP_FREE: {
+      // definitions unfold to their value, axioms and unknowns stay stuck
+      Global* global = arena->globals ? globals_get(arena->globals, expr->name) : NULL;
+      if (global && global->val) return global->val;
+
+      Value* val = val_new(arena, VAL_NEU);
+      val->name = expr->name;
+      val->neu.head = HEAD_FREE;
+      return val;
+    }
+    case EXP_SPINE: {
+      Value* fn = nbe_eval(arena, env, expr->spine.nodes[0]);
+      for (int i = 1; fn && i <= expr->spine.len; i++) {
+        fn = nbe_apply(arena, fn, nbe_eval(arena, env, expr->spine.nodes[i]));
+      }
+      return fn;
+    }
+    case EXP_LAM: {
+      Value* val = val_new(arena, VAL_LAM);
+      val->name = expr->name;
+      val->lam.dom = nbe_eval(arena, env, expr->lam.lhs->term.ann);
+      val->lam.body = closure_new(env, expr->lam.rhs);
+      return val->lam.dom ? val : NULL;
+    }
+    case EXP_PI: {
+      Value* val = val_new(arena, VAL_PI);
+      val->name = expr->name;
+      val->dep = expr->dep;
+      val->pi.dom = nbe_eval(arena, env, expr->pi.lhs->term.ann);
+      val->pi.body = closure_new(env, expr->pi.rhs);
+      return val->pi.dom ? val : NULL;
+    }
+  }
+  return NULL;
+}
+
+Value* nbe_inst (Arena* arena, Closure* closure, Value* arg) {
+  return nbe_eval(arena, env_push(arena, closure->env, arg), closure->body);
+}
+
+// ill-typed applications have no value and yield NULL
+Value* nbe_apply (Arena* arena, Value* fn, Value* arg) {
+  if (fn == NULL || arg == NULL) return NULL;
+
+  switch (fn->typ) {
+    case VAL_LAM: 
+      return nbe_inst(arena, &fn->lam.body, arg);
+    case VAL_NEU: {
+      Value* val = val_new(arena, VAL_NEU);
+      memcpy(val, fn, sizeof(Value));
+      Spine* spine = arena_alloc(arena, sizeof(Spine));
+      spine->arg = arg;
+      spine->prev = fn->neu.spine;
+      val->neu.spine = spine;
+      return val;
+    }
+    default: 
+      return NULL;
+  }
+}
+
+//  the spine holds the last argument first, its arguments are quoted
+//  from the first one on into the nodes of a single spine
+Expr* quote_spine (Arena* arena, int depth, Expr* head, Spine* spine) {
+  if (spine == NULL) return head;
+
+  int len = 0;
+  for (Spine* arg = spine; arg; arg = arg->prev) len++;
+
+  Expr** nodes = arena_alloc(arena, (len + 1) * sizeof(Expr*));
+  nodes[0] = head;
+  for (int i = len; i > 0; i--, spine = spine->prev) {
+    nodes[i] = nbe_quote(arena, depth, spine->arg);
+    if (nodes[i] == NULL) return NULL;
+  }
+
+  Expr app;
+  memset(&app, 0, sizeof(Expr));
+  app.typ = EXP_SPINE;
+  app.spine.len = len;
+  app.spine.nodes = nodes;
+  return expr_alloc(arena, &app);
+}
+
+// reads a binder back, its variable takes the level 'depth'
+Expr* quote_bind (Arena* arena, int depth, Value* val, Value* dom, Closure* body) {
+  Expr bind;
+  memset(&bind, 0, sizeof(Expr));
+  bind.typ = EXP_TERM;
+  bind.name = val->name;
+  bind.term.ann = nbe_quote(arena, depth, dom);
+
+  Value* inst = nbe_inst(arena, body, nbe_var(arena, depth, val->name));
+
+  Expr expr;
+  memset(&expr, 0, sizeof(Expr));
+  expr.typ = val->typ == VAL_LAM ? EXP_LAM : EXP_PI;
+  expr.name = val->name;
+  expr.lam.lhs = expr_alloc(arena, &bind);
+  expr.lam.rhs = nbe_quote(arena, depth + 1, inst);
+  if (!bind.term.ann || !expr.lam.rhs) return NULL;
+  // normalizing may drop the last use of the variable
+  expr.dep = expr.typ == EXP_PI ? occurs(expr.lam.rhs, 0) : val->dep;
+  return expr_alloc(arena, &expr);
+}
+
+Expr* nbe_quote (Arena* arena, int depth, Value* val) {
+  if (val == NULL) return NULL;
+  if (deep_low()) {
+    NbeCall call = { .arena = arena, .depth = depth, .lhs = val };
+    deep_run(quote_deep, &call);
+    return call.res;
+  }
+
+  Expr expr;
+  memset(&expr, 0, sizeof(Expr));
+
+  switch (val->typ) {
+    case VAL_KIND:
+      expr.typ = EXP_KIND;
+      return expr_alloc(arena, &expr);
+    case VAL_NEU:
+      expr.typ = val->neu.head == HEAD_VAR ? EXP_TERM : EXP_FREE;
+      expr.name = val->name;
+      expr.term.idx = depth - 1 - val->neu.level;
+      return quote_spine(arena, depth, expr_alloc(arena, &expr), val->neu.spine);
+    case VAL_LAM: 
+      return quote_bind(arena, depth, val, val->lam.dom, &val->lam.body);
+    case VAL_PI: 
+      return quote_bind(arena, depth, val, val->pi.dom, &val->pi.body);
+  }
+  return NULL;
+}
+
+// 'env' binds the 'depth' variables in scope of 'expr'
+Expr* nbe_normalize (Arena* arena, Env* env, int depth, Expr* expr) {
+  return nbe_quote(arena, depth, nbe_eval(arena, env, expr));
+}
+
+int conv_spine (Arena* arena, int depth, Spine* lhs, Spine* rhs) {
+  while (lhs && rhs) {
+    if (!nbe_conv_val(arena, depth, lhs->arg, rhs->arg)) return 0;
+    lhs = lhs->prev;
+    rhs = rhs->prev;
+  }
+  return lhs == rhs;
+}
+
+// compares two values under 'depth' binders, fresh variables take levels from 'depth'
+int nbe_conv_val (Arena* arena, int depth, Value* lhs, Value* rhs) {
+  if (lhs == NULL || rhs == NULL) return 0;
+  if (deep_low()) {
+    NbeCall call = { .arena = arena, .depth = depth, .lhs = lhs, .rhs = rhs };
+    deep_run(conv_deep, &call);
+    return call.conv;
+  }
+
+  // eta, a lambda is convertible with anything that behaves like it when applied
+  if (lhs->typ == VAL_LAM && rhs->typ == VAL_NEU) {
+    Value* var = nbe_var(arena, depth, lhs->name);
+    return nbe_conv_val(arena, depth + 1, nbe_inst(arena, &lhs->lam.body, var), nbe_apply(arena, rhs, var));
+  }
+  if (lhs->typ == VAL_NEU && rhs->typ == VAL_LAM) {
+    return nbe_conv_val(arena, depth, rhs, lhs);
+  }
+
+  if (lhs->typ != rhs->typ) return 0;
+
+  switch (lhs->typ) {
+    case VAL_KIND: 
+      return 1;
+    case VAL_NEU: 
+      if (lhs->neu.head != rhs->neu.head) return 0;
+      if (lhs->neu.head == HEAD_VAR && lhs->neu.level != rhs->neu.level) return 0;
+      if (lhs->neu.head == HEAD_FREE && lhs->name != rhs->name) return 0;
+      return conv_spine(arena, depth, lhs->neu.spine, rhs->neu.spine);
+    case VAL_LAM: {
+      Value* var = nbe_var(arena, depth, lhs->name);
+      return nbe_conv_val(arena, depth + 1, nbe_inst(arena, &lhs->lam.body, var), nbe_inst(arena, &rhs->lam.body, var));
+    }
+    case VAL_PI: {
+      if (!nbe_conv_val(arena, depth, lhs->pi.dom, rhs->pi.dom)) return 0;
+      Value* var = nbe_var(arena, depth, lhs->name);
+      return nbe_conv_val(arena, depth + 1, nbe_inst(arena, &lhs->pi.body, var), nbe_inst(arena, &rhs->pi.body, var));
+    }
+  }
+  return 0;
+}
+
+int nbe_conv (Arena* arena, Env* env, int depth, Expr* lhs, Expr* rhs) {
+  STAT_START(start);
+  ConvCache* cache = arena->conv;
+  int conv = cache ? ccache_get(cache, lhs, rhs) : -1;
+
+  if (conv < 0) {
+    conv = ((!cache || ccache_alike(cache, lhs, rhs)) && expr_eq(lhs, rhs)) ||
+      nbe_conv_val(arena, depth, nbe_eval(arena, env, lhs), nbe_eval(arena, env, rhs));
+    if (cache) ccache_put(cache, lhs, rhs, conv);
+  }
+  STAT_STOP(TIME_CONV, start);
+  return conv;
+}
@@ -0,0 +1,69 @@
+#ifndef __NBE_H__
+#define __NBE_H__
+
+#include "parser.h"
+
+typedef struct Value Value;
+typedef struct Env Env;
+typedef struct Spine Spine;
+
+typedef enum ValueType {
+  VAL_KIND,
+  VAL_NEU,
+  VAL_LAM,
+  VAL_PI,
+} ValueType;
+
+typedef enum HeadType {
+  HEAD_VAR,
+  HEAD_FREE,
+} HeadType;
+
+//  values of the variables in scope, index 0 first. 'jump' skips back
+//  over a skew binary number of entries so that any index is reached
+//  in a logarithmic number of steps, 'len' counts 'next' and below
+typedef struct Env {
+  Value* val;
+  Env* next;
+  Env* jump;
+  int len;
+} Env;
+
+// arguments of a stuck application, last argument first
+typedef struct Spine {
+  Value* arg;
+  Spine* prev;
+} Spine;
+
+// body of a binder with the environment it was evaluated in
+typedef struct Closure {
+  Env* env;
+  Expr* body;
+} Closure;
+
+//  variables are neutral values identified by their de Bruijn level,
+//  which unlike an index does not change as binders are crossed
+typedef struct Value {
+  ValueType typ;
+  uint8_t dep;
+  Sym name;
+
+  union {
+    struct { HeadType head; int level; Spine* spine; } neu;
+    struct { Value* dom; Closure body; } lam;
+    struct { Value* dom; Closure body; } pi;
+  };
+} Value;
+
+Value* nbe_var   (Arena* arena, int level, Sym name);
+Env*   env_push  (Arena* arena, Env* env, Value* val);
+Value* nbe_eval  (Arena* arena, Env* env, Expr* expr);
+Value* nbe_apply (Arena* arena, Value* fn, Value* arg);
+Value* nbe_inst  (Arena* arena, Closure* closure, Value* arg);
+Expr*  nbe_quote (Arena* arena, int depth, Value* val);
+
+Expr* nbe_normalize (Arena* arena, Env* env, int depth, Expr* expr);
+int nbe_conv (Arena* arena, Env* env, int depth, Expr* lhs, Expr* rhs);
+int nbe_conv_val (Arena* arena, int depth, Value* lhs, Value* rhs);
+
+#endif
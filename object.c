@@ -0,0 +1,515 @@
+#include "object.h"
+#include "source.h"
+#include "driver.h"
+#include "deep.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#define OBJ_ALIGN 16
+
+VEC_DEFINE(ObjDeclVec, ObjDecl)
+VEC_DEFINE(ObjSymVec, ObjSym)
+VEC_DEFINE(ObjNodeVec, ObjNode)
+VEC_DEFINE(ObjLinkVec, uint32_t)
+VEC_DEFINE(CharVec, char)
+
+static uint64_t align_up (uint64_t off) {
+  return (off + OBJ_ALIGN - 1) & ~(uint64_t)(OBJ_ALIGN - 1);
+}
+
+//  sections are built in memory and written out in one go, nodes and
+//  names already written are found again by address and by symbol
+typedef struct Writer {
+  ObjDeclVec decls;
+  ObjSymVec syms;
+  ObjNodeVec nodes;
+  ObjLinkVec links;
+  CharVec strings;
+  Hashmap* by_expr;
+  Hashmap* by_sym;
+} Writer;
+
+// symbol 0 is the empty name in the object as in the symtab
+static uint32_t write_sym (Writer* w, Sym sym) {
+  if (sym == SYM_NONE) return 0;
+
+  uintptr_t idx = (uintptr_t)hmap_get(w->by_sym, sym, sym_hash_of(sym));
+  if (idx) return idx - 1;
+
+  ObjSym entry = { w->strings.len, sym_len(sym), sym_hash_of(sym) };
+  CharVec_extend(&w->strings, sym_name(sym), sym_len(sym) + 1);
+  ObjSymVec_push(&w->syms, entry);
+  hmap_add(w->by_sym, sym, sym_hash_of(sym), (void*)(uintptr_t)w->syms.len);
+  return w->syms.len - 1;
+}
+
+static uint32_t write_node (Writer* w, Expr* expr);
+
+//  encoding and decoding follow the nesting of the term and move to a
+//  heap segment when the stack runs low, see deep.h
+typedef struct NodeCall {
+  Writer* w;
+  Object* obj;
+  Globals* globals;
+  Hashmap* seen;
+  Expr* expr;
+  uint32_t idx;
+} NodeCall;
+
+static void write_deep (void* data) {
+  NodeCall* call = data;
+  call->idx = write_node(call->w, call->expr);
+}
+
+// children are written first, a node shared by several parents once
+static uint32_t write_node (Writer* w, Expr* expr) {
+  if (deep_low()) {
+    NodeCall call = { .w = w, .expr = expr };
+    deep_run(write_deep, &call);
+    return call.idx;
+  }
+
+  uint64_t key = (uintptr_t)expr;
+  uintptr_t idx = (uintptr_t)hmap_get(w->by_expr, key, key);
+  if (idx) return idx - 1;
+
+  int32_t a = 0;
+  int32_t b = 0;
+  switch (expr->typ) {
+    case EXP_FREE:
+    case EXP_TERM:
+      a = expr->term.idx;
+      if (expr->term.ann) b = write_node(w, expr->term.ann) + 1;
+      break;
+    case EXP_SPINE:
+      // its links are taken first, nested spines add theirs after
+      a = expr->spine.len;
+      b = w->links.len;
+      ObjLinkVec_reserve(&w->links, b + a + 1);
+      w->links.len += a + 1;
+      for (int i = 0; i <= a; i++) {
+        uint32_t link = write_node(w, expr->spine.nodes[i]);
+        w->links.data[b + i] = link;
+      }
+      break;
+    case EXP_LAM:
+    case EXP_PI:
+      a = write_node(w, expr->lam.lhs) + 1;
+      b = write_node(w, expr->lam.rhs) + 1;
+      break;
+    default:
+      break;
+  }
+
+  // children become offsets back from this node
+  int32_t self = w->nodes.len;
+  ObjNode node = { expr->typ, expr->dep, 0, write_sym(w, expr->name), 0, 0 };
+  if (expr->typ == EXP_FREE || expr->typ == EXP_TERM) {
+    node.a = a;
+    node.b = b ? b - 1 - self : 0;
+  } else if (expr->typ == EXP_SPINE) {
+    node.a = a;
+    node.b = b;
+  } else if (a) {
+    node.a = a - 1 - self;
+    node.b = b - 1 - self;
+  }
+
+  ObjNodeVec_push(&w->nodes, node);
+  hmap_add(w->by_expr, key, key, (void*)(uintptr_t)(self + 1));
+  return self;
+}
+
+static void write_section (FILE* file, uint64_t* off, const void* data, size_t size) {
+  static const char zeros [OBJ_ALIGN] = { 0 };
+  fwrite(data, 1, size, file);
+  *off += size;
+
+  uint64_t next = align_up(*off);
+  fwrite(zeros, 1, next - *off, file);
+  *off = next;
+}
+
+int object_save (const char* path, Globals* globals, uint64_t hash, uint64_t size, int64_t mtime) {
+  Writer w;
+  ObjDeclVec_init(&w.decls, globals->decls.len);
+  ObjSymVec_init(&w.syms, 64);
+  ObjNodeVec_init(&w.nodes, 256);
+  ObjLinkVec_init(&w.links, 256);
+  CharVec_init(&w.strings, 1024);
+  w.by_expr = hmap_new();
+  w.by_sym = hmap_new();
+
+  ObjSym empty = { 0, 0, sym_hash_of(SYM_NONE) };
+  ObjSymVec_push(&w.syms, empty);
+  CharVec_push(&w.strings, '\0');
+
+  for (int i = 0; i < globals->decls.len; i++) {
+    Global* global = globals->decls.data[i];
+    if (global->type == NULL || global->pos < 0) continue;
+
+    ObjDecl decl = { write_sym(&w, global->name), write_node(&w, global->type), OBJ_NONE, 0 };
+    if (global->value) decl.value = write_node(&w, global->value);
+    ObjDeclVec_push(&w.decls, decl);
+  }
+
+  // at most half full so misses end quickly
+  uint32_t slots = 16;
+  while (slots < 2 * (uint32_t)w.decls.len) slots *= 2;
+  uint32_t* index = calloc(slots, sizeof(uint32_t));
+  for (int i = 0; i < w.decls.len; i++) {
+    uint32_t slot = w.syms.data[w.decls.data[i].name].hash & (slots - 1);
+    while (index[slot]) slot = (slot + 1) & (slots - 1);
+    index[slot] = i + 1;
+  }
+
+  ObjHeader header;
+  memset(&header, 0, sizeof(ObjHeader));
+  header.magic = OBJ_MAGIC;
+  header.version = OBJ_VERSION;
+  header.src_hash = hash;
+  header.src_size = size;
+  header.src_mtime = mtime;
+  header.ndecls = w.decls.len;
+  header.nsyms = w.syms.len;
+  header.nnodes = w.nodes.len;
+  header.nlinks = w.links.len;
+  header.mask = slots - 1;
+  header.decls = align_up(sizeof(ObjHeader));
+  header.index = align_up(header.decls + w.decls.len * sizeof(ObjDecl));
+  header.syms = align_up(header.index + slots * sizeof(uint32_t));
+  header.nodes = align_up(header.syms + w.syms.len * sizeof(ObjSym));
+  header.links = align_up(header.nodes + w.nodes.len * sizeof(ObjNode));
+  header.strings = align_up(header.links + w.links.len * sizeof(uint32_t));
+  header.size = align_up(header.strings + w.strings.len);
+
+  // written aside and renamed over, so readers never see half a file
+  char tmp [BUF_LEN];
+  snprintf(tmp, BUF_LEN, "%s.tmp", path);
+  FILE* file = fopen(tmp, "wb");
+  int saved = file != NULL;
+
+  if (file) {
+    uint64_t off = 0;
+    write_section(file, &off, &header, sizeof(ObjHeader));
+    write_section(file, &off, w.decls.data, w.decls.len * sizeof(ObjDecl));
+    write_section(file, &off, index, slots * sizeof(uint32_t));
+    write_section(file, &off, w.syms.data, w.syms.len * sizeof(ObjSym));
+    write_section(file, &off, w.nodes.data, w.nodes.len * sizeof(ObjNode));
+    write_section(file, &off, w.links.data, w.links.len * sizeof(uint32_t));
+    write_section(file, &off, w.strings.data, w.strings.len);
+    saved = fclose(file) == 0 && rename(tmp, path) == 0;
+  }
+  if (!saved) printf("cannot write '%s'\n", path);
+
+  free(index);
+  ObjDeclVec_free(&w.decls);
+  ObjSymVec_free(&w.syms);
+  ObjNodeVec_free(&w.nodes);
+  ObjLinkVec_free(&w.links);
+  CharVec_free(&w.strings);
+  hmap_delete(w.by_expr);
+  hmap_delete(w.by_sym);
+  return saved;
+}
+
+static int section_fits (uint64_t off, uint64_t len, size_t size) {
+  return off % OBJ_ALIGN == 0 && off <= size && len <= size - off;
+}
+
+Object* object_load (const char* path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(ObjHeader)) {
+    close(fd);
+    return NULL;
+  }
+
+  size_t size = st.st_size;
+  const char* base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return NULL;
+
+  const ObjHeader* h = (const ObjHeader*)base;
+  int valid = h->magic == OBJ_MAGIC && h->version == OBJ_VERSION && h->size == size &&
+    ((h->mask + 1) & h->mask) == 0 &&
+    section_fits(h->decls, (uint64_t)h->ndecls * sizeof(ObjDecl), size) &&
+    section_fits(h->index, ((uint64_t)h->mask + 1) * sizeof(uint32_t), size) &&
+    section_fits(h->syms, (uint64_t)h->nsyms * sizeof(ObjSym), size) &&
+    section_fits(h->nodes, (uint64_t)h->nnodes * sizeof(ObjNode), size) &&
+    section_fits(h->links, (uint64_t)h->nlinks * sizeof(uint32_t), size) &&
+    section_fits(h->strings, 0, size);
+
+  if (!valid) {
+    munmap((void*)base, size);
+    return NULL;
+  }
+
+  Object* obj = malloc(sizeof(Object));
+  obj->base = base;
+  obj->map = size;
+  obj->header = h;
+  obj->decls = (const ObjDecl*)(base + h->decls);
+  obj->index = (const uint32_t*)(base + h->index);
+  obj->syms = (const ObjSym*)(base + h->syms);
+  obj->nodes = (const ObjNode*)(base + h->nodes);
+  obj->links = (const uint32_t*)(base + h->links);
+  obj->strings = base + h->strings;
+  // zeroed pages are only touched for names that are looked up
+  obj->interned = calloc(h->nsyms, sizeof(Sym));
+  obj->imported = calloc(h->ndecls, sizeof(*obj->imported));
+  obj->next = NULL;
+  return obj;
+}
+
+void object_close (Object* obj) {
+  munmap((void*)obj->base, obj->map);
+  free(obj->interned);
+  free(obj->imported);
+  free(obj);
+}
+
+//  only the header is checked on load, everything past it is checked
+//  as it is read. a name must be NUL terminated within the strings
+static const ObjSym* object_sym_at (Object* obj, uint32_t idx) {
+  uint64_t chars = obj->map - obj->header->strings;
+  if (idx >= obj->header->nsyms) return NULL;
+
+  const ObjSym* sym = &obj->syms[idx];
+  if (sym->off >= chars || sym->len >= chars - sym->off) return NULL;
+  return obj->strings[sym->off + sym->len] == '\0' ? sym : NULL;
+}
+
+//  probes the mapped index in place, comparing names by their text. a
+//  damaged index can only end the search early, as at most every slot
+//  is probed once
+static int object_find (Object* obj, Sym name) {
+  uint32_t hash = sym_hash_of(name);
+  int len = sym_len(name);
+  const char* text = sym_name(name);
+
+  uint32_t slot = hash & obj->header->mask;
+  for (uint32_t probe = 0; probe <= obj->header->mask; probe++, slot = (slot + 1) & obj->header->mask) {
+    uint32_t entry = obj->index[slot];
+    if (entry == 0 || entry > obj->header->ndecls) return -1;
+
+    const ObjSym* sym = object_sym_at(obj, obj->decls[entry - 1].name);
+    if (sym && sym->hash == hash && sym->len == (uint32_t)len && memcmp(obj->strings + sym->off, text, len) == 0) {
+      return entry - 1;
+    }
+  }
+  return -1;
+}
+
+//  SYM_NONE for a name that is damaged, its stored hash is checked
+//  before it is interned under it
+static Sym object_sym (Object* obj, uint32_t idx) {
+  if (idx == 0) return SYM_NONE;
+  if (idx < obj->header->nsyms && obj->interned[idx] != SYM_NONE) return obj->interned[idx];
+
+  const ObjSym* sym = object_sym_at(obj, idx);
+  if (sym == NULL || sym->hash != sym_hash(obj->strings + sym->off, sym->len)) return SYM_NONE;
+  obj->interned[idx] = sym_intern(obj->strings + sym->off, sym->len, sym->hash);
+  return obj->interned[idx];
+}
+
+//  decodes the node at 'idx' into the table's arena, 'seen' keeps
+//  shared nodes shared. free names are imported as they are met so
+//  evaluating the result never has to. returns NULL for a damaged
+//  node: its children must come strictly before it, as the writer puts
+//  them, which also rules out cycles
+static Expr* object_expr (Object* obj, Globals* globals, Hashmap* seen, uint32_t idx);
+
+static void expr_deep (void* data) {
+  NodeCall* call = data;
+  call->expr = object_expr(call->obj, call->globals, call->seen, call->idx);
+}
+
+static Expr* object_expr (Object* obj, Globals* globals, Hashmap* seen, uint32_t idx) {
+  if (deep_low()) {
+    NodeCall call = { .obj = obj, .globals = globals, .seen = seen, .idx = idx };
+    deep_run(expr_deep, &call);
+    return call.expr;
+  }
+
+  Expr* done = hmap_get(seen, idx, idx);
+  if (done) return done;
+
+  const ObjNode* node = &obj->nodes[idx];
+  int64_t at = idx;
+  Expr expr;
+  memset(&expr, 0, sizeof(Expr));
+  expr.typ = node->typ;
+  expr.dep = node->dep;
+  expr.name = object_sym(obj, node->name);
+  if (expr.name == SYM_NONE && node->name != 0) return NULL;
+
+  switch (node->typ) {
+    case EXP_FREE:
+    case EXP_TERM:
+      if (node->a < 0 || node->b > 0 || at + node->b < 0) return NULL;
+      if (node->typ == EXP_FREE) globals_find(globals, expr.name);
+      expr.term.idx = node->a;
+      if (node->b) expr.term.ann = object_expr(obj, globals, seen, idx + node->b);
+      if (node->b && expr.term.ann == NULL) return NULL;
+      break;
+    case EXP_KIND:
+      break;
+    case EXP_SPINE: {
+      if (node->a < 0 || node->b < 0 || (uint64_t)node->b + node->a + 1 > obj->header->nlinks) return NULL;
+      const uint32_t* links = obj->links + node->b;
+      expr.spine.len = node->a;
+      expr.spine.nodes = arena_alloc(globals->arena, (node->a + 1) * sizeof(Expr*));
+      for (int i = 0; i <= node->a; i++) {
+        if (links[i] >= idx) return NULL;
+        expr.spine.nodes[i] = object_expr(obj, globals, seen, links[i]);
+        if (expr.spine.nodes[i] == NULL) return NULL;
+      }
+      break;
+    }
+    case EXP_LAM:
+    case EXP_PI:
+      if (node->a >= 0 || node->b >= 0 || at + node->a < 0 || at + node->b < 0) return NULL;
+      expr.lam.lhs = object_expr(obj, globals, seen, idx + node->a);
+      expr.lam.rhs = object_expr(obj, globals, seen, idx + node->b);
+      if (!expr.lam.lhs || !expr.lam.rhs) return NULL;
+      // a binder is a variable with its annotation, as the parser makes it
+      if (expr.lam.lhs->typ != EXP_TERM || expr.lam.lhs->term.ann == NULL) return NULL;
+      break;
+    default:
+      return NULL;
+  }
+
+  done = expr_alloc(globals->arena, &expr);
+  hmap_add(seen, idx, idx, done);
+  return done;
+}
+
+//  decoding may import other declarations, from this object or another,
+//  so the thread holding the lock takes it only once. declarations it
+//  is still decoding are found in 'pending', which only it reads
+typedef struct Pending {
+  Object* obj;
+  int idx;
+  Global* global;
+  struct Pending* next;
+} Pending;
+
+static pthread_mutex_t import_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local int importing;
+static Pending* pending;
+
+static Global* object_decode (Object* obj, Globals* globals, Sym name, int idx) {
+  // another thread may have decoded it while this one waited
+  Global* global = atomic_load_explicit(&obj->imported[idx], memory_order_relaxed);
+  if (global) return global;
+  for (Pending* p = pending; p; p = p->next) {
+    if (p->obj == obj && p->idx == idx) return p->global;
+  }
+
+  global = arena_alloc(globals->arena, sizeof(Global));
+  memset(global, 0, sizeof(Global));
+  global->name = name;
+  global->pos = -1;
+
+  // pending before its terms are decoded, so references back find it
+  Pending self = { obj, idx, global, pending };
+  pending = &self;
+  const ObjDecl* decl = &obj->decls[idx];
+  uint32_t nodes = obj->header->nnodes;
+  if (decl->type < nodes && (decl->value == OBJ_NONE || decl->value < nodes)) {
+    Hashmap* seen = hmap_new();
+    Expr* type = object_expr(obj, globals, seen, decl->type);
+    Expr* value = decl->value != OBJ_NONE ? object_expr(obj, globals, seen, decl->value) : NULL;
+    if (type && (value || decl->value == OBJ_NONE)) global_define(global, globals->arena, type, value);
+    hmap_delete(seen);
+  }
+  pending = self.next;
+
+  atomic_store_explicit(&obj->imported[idx], global, memory_order_release);
+  return global;
+}
+
+Global* object_import (Object* obj, Globals* globals, Sym name) {
+  int idx = object_find(obj, name);
+  if (idx < 0) return NULL;
+
+  Global* global = atomic_load_explicit(&obj->imported[idx], memory_order_acquire);
+  if (global) return global;
+
+  int outer = !importing;
+  if (outer) {
+    pthread_mutex_lock(&import_lock);
+    importing = 1;
+  }
+  global = object_decode(obj, globals, name, idx);
+  if (outer) {
+    importing = 0;
+    pthread_mutex_unlock(&import_lock);
+  }
+  return global;
+}
+
+//  checks the library source on its own and saves what passed
+static int library_build (const char* path, Source* src, uint64_t hash, int64_t mtime, FILE* log) {
+  fprintf(log, "building '%s'\n", path);
+
+  Globals* globals = globals_new();
+  Arena* arena = arena_new();
+  arena->globals = globals;
+
+  Tokens toks = tokens_stream(src->data, src->len);
+  Printer out;
+  printer_init(&out, sink_file, log, print_width);
+  check_decls(arena, NULL, &toks, &out);
+  printer_flush(&out);
+  printer_free(&out);
+  tokens_free(&toks);
+
+  int saved = object_save(path, globals, hash, src->len, mtime);
+  arena_delete(arena);
+  globals_delete(globals);
+  return saved;
+}
+
+Object* library_open (const char* path, FILE* log) {
+  char obj_path [BUF_LEN];
+  snprintf(obj_path, BUF_LEN, "%so", path);
+
+  struct stat st;
+  if (stat(path, &st) < 0) {
+    fprintf(log, "cannot open '%s'\n", path);
+    return NULL;
+  }
+
+  // an unchanged stamp is trusted, otherwise the contents decide
+  int64_t mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+  Object* obj = object_load(obj_path);
+  if (obj && obj->header->src_size == (uint64_t)st.st_size && obj->header->src_mtime == mtime) {
+    return obj;
+  }
+
+  Source src;
+  if (!source_map(path, &src)) {
+    if (obj) object_close(obj);
+    return NULL;
+  }
+
+  uint64_t hash = source_hash(src.data, src.len);
+  int fresh = obj && obj->header->src_size == src.len && obj->header->src_hash == hash;
+  if (obj && !fresh) {
+    object_close(obj);
+    obj = NULL;
+  }
+
+  if (!fresh && library_build(obj_path, &src, hash, mtime, log)) obj = object_load(obj_path);
+  source_unmap(&src);
+  return obj;
+}
@@ -0,0 +1,117 @@
+#ifndef __OBJECT_H__
+#define __OBJECT_H__
+
+#include "globals.h"
+#include <stdatomic.h>
+
+// "LAMO" read as a little-endian word
+#define OBJ_MAGIC   0x4f4d414c
+#define OBJ_VERSION 2
+
+//  ___________________________________________________
+// | header  | magic, version, source stamp, offsets   |
+// | decls   | name, type and value root of each one   |
+// | index   | open-addressed by name hash, decl + 1   |
+// | syms    | offset, length and hash of each name    |
+// | nodes   | expressions, children before parents    |
+// | links   | node indices of the nodes of each spine |
+// | strings | names, NUL terminated                   |
+//  ---------------------------------------------------
+//  the file holds no pointers, so it is used as mapped. sections start
+//  on 16-byte boundaries and offsets are from the start of the file
+typedef struct ObjHeader {
+  uint32_t magic;
+  uint32_t version;
+  // the source the object was built from, size and mtime are checked
+  // first and the hash only when they differ
+  uint64_t src_hash;
+  uint64_t src_size;
+  int64_t src_mtime;
+
+  uint32_t ndecls;
+  uint32_t nsyms;
+  uint32_t nnodes;
+  uint32_t mask;
+  uint32_t nlinks;
+  uint32_t pad;
+
+  uint64_t decls;
+  uint64_t index;
+  uint64_t syms;
+  uint64_t nodes;
+  uint64_t links;
+  uint64_t strings;
+  uint64_t size;
+} ObjHeader;
+
+// roots are node indices, an axiom's value is OBJ_NONE
+#define OBJ_NONE UINT32_MAX
+
+typedef struct ObjDecl {
+  uint32_t name;
+  uint32_t type;
+  uint32_t value;
+  uint32_t pad;
+} ObjDecl;
+
+typedef struct ObjSym {
+  uint32_t off;
+  uint32_t len;
+  uint32_t hash;
+} ObjSym;
+
+//  an Expr with names as symbol indices and children as offsets in
+//  nodes from the node itself, zero when absent. 'a' and 'b' are the
+//  index and annotation of a variable, the argument count and first
+//  link of a spine or the two children of a binder
+typedef struct ObjNode {
+  uint8_t typ;
+  uint8_t dep;
+  uint16_t pad;
+  uint32_t name;
+  int32_t a;
+  int32_t b;
+} ObjNode;
+
+//  a mapped object, declarations are decoded into a table the first
+//  time it looks one of their names up. 'interned' caches the symbol
+//  of each name and 'imported' the decoded declaration, zero until they
+//  are first needed. a decoded one is published once it is defined, so
+//  any thread may read 'imported' without a lock
+typedef struct Object {
+  const char* base;
+  size_t map;
+  const ObjHeader* header;
+  const ObjDecl* decls;
+  const uint32_t* index;
+  const ObjSym* syms;
+  const ObjNode* nodes;
+  const uint32_t* links;
+  const char* strings;
+  Sym* interned;
+  _Atomic(Global*)* imported;
+  Object* next;
+} Object;
+
+//  writes every declaration of 'globals' that passed, stamped with the
+//  source it came from. returns 0 if the file could not be written
+int object_save (const char* path, Globals* globals, uint64_t hash, uint64_t size, int64_t mtime);
+
+//  NULL when the file is missing, truncated or of another version. only
+//  the header is read here, so loading costs the same for any size
+Object* object_load (const char* path);
+void object_close (Object* obj);
+
+//  maps the object of a library source, 'path' followed by 'o', and
+//  first rebuilds it by checking the source if it is missing or stale.
+//  what the rebuild reports goes to 'log'
+Object* library_open (const char* path, FILE* log);
+
+//  the declaration of 'name' in the object, decoded into the arena of
+//  'globals' the first time along with whatever its terms refer to, or
+//  NULL if the object lacks it. one the object holds damaged is left
+//  failed, like a declaration that did not check. may be called from 
+//  any thread, decoding is serialized and each declaration done once
+Global* object_import (Object* obj, Globals* globals, Sym name);
+
+#endif
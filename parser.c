@@ -1,14 +1,21 @@
 #include "parser.h"
 #include "strop.h"
 #include "hashmap.h"
+#include "hashcons.h"
+#include "stats.h"
+#include "deep.h"
 #include <stdarg.h>
 
 typedef struct Parser {
-  VEC(Token) stream;
+  Arena* arena;
+  Tokens* stream;
   int binding;
   int dummies;
+  int depth;
   Hashmap* binds;
-  Token* ptr; 
+  // nodes and their first tokens, NULL unless tracked
+  WhereVec* where;
+  int ptr; 
   char mes [BUF_LEN];
 } Parser;
 
@@ -29,24 +36,24 @@ int push_err (Parser* parser, const char* fmt, ...) {
   return 0;
 }
 
-Token* at (Parser* parser) {
-  return parser->ptr;
+TokenType at (Parser* parser) {
+  return tok_type(parser->stream, parser->ptr);
 }
 
 int eof (Parser* parser) {
-  return at(parser)->type == TOK_END_OF_INPUT;
+  return at(parser) == TOK_END_OF_INPUT;
 }
 
 int expect (Parser* parser, TokenType typ) {
-  if (at(parser)->type == typ) return 1;
-  push_err(parser, "expected '%s', found '%s'", tok(typ), tok(at(parser)->type));
+  if (at(parser) == typ) return 1;
+  push_err(parser, "expected '%s', found '%s'", tok(typ), tok(at(parser)));
   return 0;
 }
 
-Token* eat (Parser* parser) {
-  Token* tok = at(parser);
+int eat (Parser* parser) {
+  int idx = parser->ptr;
   if (!eof(parser)) parser->ptr++;
-  return tok;
+  return idx;
 }
 
 int try_eat (Parser* parser, TokenType typ) {
@@ -64,7 +71,7 @@ Assoc new_assoc (AssocType typ, int bp) {
 
 Expr new_expr () {
   Expr expr;
-  expr.annot.typ = ANN_EMPTY;
+  memset(&expr, 0, sizeof(Expr));
   return expr;
 }
 
@@ -76,12 +83,142 @@ int assoc_bp (Assoc assoc) {
   }
 }
 
-Expr* expr_alloc (Expr* expr) {
-  Expr* alloc = malloc(sizeof(Expr));
+// one multiply per word, as in FxHash, it only has to tell terms apart
+static inline uint32_t meta_hash (uint32_t seed, uint32_t val) {
+  return (((seed << 5) | (seed >> 27)) ^ val) * 0x9e3779b9u;
+}
+
+static inline uint32_t meta_add (uint32_t lhs, uint32_t rhs) {
+  return lhs > UINT32_MAX - rhs ? UINT32_MAX : lhs + rhs;
+}
+
+static inline uint32_t fv_rotate (uint32_t fv, int by) {
+  by = ((by % EXPR_FV_BITS) + EXPR_FV_BITS) % EXPR_FV_BITS;
+  return by ? (fv << by) | (fv >> (EXPR_FV_BITS - by)) : fv;
+}
+
+//  adds free indices from 'low' up to 'bound' with bits 'fv' counted 
+//  from 'at', which is 'low' unless a bound variable was dropped below 
+//  it. whichever bits sit lowest are rotated to keep counting from there
+static void meta_free (Expr* expr, int low, int at, int bound, uint32_t fv) {
+  if (bound <= 0) return;
+  if (expr->bound == 0) {
+    expr->low = low;
+    expr->fv = fv_rotate(fv, at - low);
+  }
+  else {
+    int from = low < expr->low ? low : expr->low;
+    expr->fv = fv_rotate(expr->fv, expr->low - from) | fv_rotate(fv, at - from);
+    expr->low = from;
+  }
+  if (bound > expr->bound) expr->bound = bound;
+}
+
+//  folds the metadata of a child into its parent, 'shift' is how many
+//  binders the child sits under. a missing annotation adds nothing
+static void meta_child (Expr* expr, Expr* child, int shift) {
+  uint32_t hash = child ? child->hash : 0;
+  expr->hash = meta_hash(expr->hash, hash);
+  if (child == NULL) return;
+
+  //  the child's bound variable is dropped while its bit is known to be
+  //  only its. what was next above it is not known, so 'low' becomes 0
+  //  and stays a lower bound. a bit that is not known to be only its is
+  //  kept and may later stand for an index that is not free at all
+  uint32_t fv = child->fv;
+  int at = child->low - shift;
+  if (at < 0) {
+    if (expr_fv_exact(child)) fv &= ~1u;
+    else expr->flags |= EXPR_FV_LOOSE;
+  }
+  expr->flags |= child->flags & EXPR_FV_LOOSE;
+  meta_free(expr, at < 0 ? 0 : at, at, child->bound - shift, fv);
+  expr->size = meta_add(expr->size, child->size);
+}
+
+//  sets what later passes would otherwise walk the node for, from the
+//  metadata of its children:
+//  - 'hash' is structural and, like expr_eq, ignores binder names
+//  - 'bound' is one past the largest free index, zero when closed
+//  - 'low' is at most the smallest free index, and is it unless a 
+//    binder's own variable was the smallest in its body
+//  - 'fv' has bit i set when some free index is 'low' + i modulo its
+//    bits, which is exact as long as 'bound' is within them and no
+//    bit was kept for a variable that was bound on the way up
+//  - 'size' counts nodes, binders included. it saturates and shared
+//    subterms count once per use
+void expr_meta (Expr* expr) {
+  expr->hash = meta_hash(0, expr->typ + 1);
+  expr->bound = 0;
+  expr->low = 0;
+  expr->fv = 0;
+  expr->flags &= ~EXPR_FV_LOOSE;
+  expr->size = 1;
+
+  switch (expr->typ) {
+    case EXP_KIND:
+      break;
+    case EXP_FREE:
+      expr->hash = meta_hash(expr->hash, expr->name);
+      meta_child(expr, expr->term.ann, 0);
+      break;
+    case EXP_TERM:
+      expr->hash = meta_hash(expr->hash, expr->term.idx);
+      meta_child(expr, expr->term.ann, 0);
+      meta_free(expr, expr->term.idx, expr->term.idx, expr->term.idx + 1, 1);
+      break;
+    case EXP_SPINE:
+      expr->hash = meta_hash(expr->hash, expr->spine.len);
+      for (int i = 0; i <= expr->spine.len; i++) meta_child(expr, expr->spine.nodes[i], 0);
+      break;
+    case EXP_PI:
+      expr->hash = meta_hash(expr->hash, expr->dep);
+      // fallthrough
+    case EXP_LAM: {
+      // the binder is no occurrence, only its annotation is in scope
+      Expr* bind = expr->lam.lhs;
+      meta_child(expr, bind->term.ann, 0);
+      meta_child(expr, expr->lam.rhs, 1);
+      expr->size = meta_add(expr->size, 1);
+      break;
+    }
+  }
+}
+
+// 'expr' is only read, it may be a node other threads are reading too
+Expr* expr_alloc (Arena* arena, Expr* expr) {
+  STAT_INC(STAT_EXPR_ALLOC);
+  if (arena->hcons) {
+    Expr node = *expr;
+    expr_meta(&node);
+    return hcons_intern(arena->hcons, &node);
+  }
+  Expr* alloc = arena_alloc(arena, sizeof(Expr));
   memcpy(alloc, expr, sizeof(Expr));
+  alloc->flags &= ~EXPR_SHARED;
+  expr_meta(alloc);
   return alloc;
 }
 
+void spine_init (Arena* arena, Expr* res, Expr* head, Expr** args, int len) {
+  int front = head->typ == EXP_SPINE ? head->spine.len : 0;
+  Expr** nodes = arena_alloc(arena, (front + len + 1) * sizeof(Expr*));
+  if (front) memcpy(nodes, head->spine.nodes, (front + 1) * sizeof(Expr*));
+  else nodes[0] = head;
+  memcpy(nodes + front + 1, args, len * sizeof(Expr*));
+
+  memset(res, 0, sizeof(Expr));
+  res->typ = EXP_SPINE;
+  res->spine.len = front + len;
+  res->spine.nodes = nodes;
+}
+
+Expr* spine_new (Arena* arena, Expr* head, Expr** args, int len) {
+  Expr spine;
+  spine_init(arena, &spine, head, args, len);
+  return expr_alloc(arena, &spine);
+}
+
 Type* type_alloc (Type* type) {
   Type* alloc = malloc(sizeof(Type));
   memcpy(alloc, type, sizeof(Type));
@@ -107,11 +244,13 @@ int is_expr_term (ExprType typ) {
     typ == EXP_FREE;
 }
 
+// applications may reduce to a sort, the checker decides
 int is_expr_sort (ExprType typ) {
   return 
     typ == EXP_TERM || 
     typ == EXP_FREE || 
     typ == EXP_KIND ||
+    typ == EXP_SPINE ||
     typ == EXP_PI;
 }
 
@@ -123,26 +262,33 @@ int is_tok_beg (TokenType typ) {
     typ == TOK_FORALL;
 }
 
-char* expr_ident (Expr* expr) {
-  switch (expr->typ) {
-    case EXP_FREE: return expr->free;
-    case EXP_TERM: return expr->term.name;
-    default: return "";
-  }
+Expr* expr_ann (Expr* expr) {
+  return is_expr_term(expr->typ) ? expr->term.ann : NULL;
+}
+
+// the variable without its annotation, as it appears at a use site
+Expr* expr_bare (Arena* arena, Expr* expr) {
+  if (!expr_ann(expr)) return expr;
+  Expr bare = *expr;
+  bare.term.ann = NULL;
+  return expr_alloc(arena, &bare);
 }
 
-void push_bind (Parser* parser, Expr* expr) {
-  int* index = malloc(sizeof(int));
-  *index = parser->binds->len;
-  hmap_add(parser->binds, expr_ident(expr), index);
+// binds the name to the next level and returns the binding it shadows
+int* push_bind (Parser* parser, Expr* expr) {
+  int* level = arena_alloc(parser->arena, sizeof(int));
+  *level = parser->depth++;
 
   // transform free variable to a binding one
   expr->typ = EXP_TERM;
-  expr->term.idx = parser->binds->len - 1;
+  expr->term.idx = 0;
+  return hmap_add(parser->binds, expr->name, sym_hash_of(expr->name), level);
 }
 
-void rem_bind (Parser* parser, Expr* expr) {
-  hmap_rem(parser->binds, expr_ident(expr));
+void rem_bind (Parser* parser, Expr* expr, int* prev) {
+  parser->depth--;
+  if (prev) hmap_add(parser->binds, expr->name, sym_hash_of(expr->name), prev);
+  else hmap_rem(parser->binds, expr->name, sym_hash_of(expr->name));
 }
 
 Assoc expr_assoc (TokenType type) {
@@ -156,51 +302,200 @@ Assoc expr_assoc (TokenType type) {
   }
 }
 
-int parse (VEC(Token) tokens, Expr* res) {
-  Parser parser;
-  memset(parser.mes, '\0', BUF_LEN);
-  parser.stream = tokens;
-  parser.ptr = tokens;
-  parser.binding = 0;
-  parser.dummies = 0;
-  parser.binds = hmap_new();
+Parser* parser_new (Arena* arena, Tokens* tokens) {
+  Parser* parser = malloc(sizeof(Parser));
+  memset(parser->mes, '\0', BUF_LEN);
+  parser->arena = arena;
+  parser->stream = tokens;
+  parser->ptr = 0;
+  parser->binding = 0;
+  parser->dummies = 0;
+  parser->depth = 0;
+  parser->binds = hmap_new();
+  parser->where = NULL;
+  return parser;
+}
 
-  int pass = parse_expr(&parser, new_assoc(RASSOC, 0), res);
+void parser_delete (Parser* parser) {
+  hmap_delete(parser->binds);
+  free(parser);
+}
+
+void parser_track (Parser* parser, WhereVec* where) {
+  parser->where = where;
+}
 
-  if (!pass) {
-    printf("%s at (%d, %d)\n", parser.mes, parser.ptr->col, parser.ptr->row);
+int parser_where (Parser* parser, Expr* expr) {
+  if (parser->where == NULL) return -1;
+  for (int i = 0; i < parser->where->len; i++) {
+    if (parser->where->data[i].expr == expr) return parser->where->data[i].tok;
   }
+  return -1;
+}
+
+//  allocates a node parsed from token 'from' on. a shared node is found
+//  at the first place it was met
+static Expr* parser_alloc (Parser* parser, Expr* expr, int from) {
+  Expr* alloc = expr_alloc(parser->arena, expr);
+  if (parser->where && from >= 0) WhereVec_push(parser->where, (Where){ alloc, from });
+  return alloc;
+}
 
-  //hmap_delete(parser.binds);
+// the last error, 'row' and 'col' receive where it was found
+const char* parser_message (Parser* parser, int* row, int* col) {
+  tok_pos(parser->stream, parser->ptr, row, col);
+  return parser->mes;
+}
+
+//  formats the last error with its position into 'buf'. the message is
+//  cut short so the position always fits
+void parser_error (Parser* parser, char* buf, int len) {
+  int row, col;
+  const char* mes = parser_message(parser, &row, &col);
+  int room = len > 32 ? len - 32 : 0;
+  snprintf(buf, len, "%.*s at (%d, %d)", room, mes, col, row);
+}
+
+void parser_report (Parser* parser) {
+  char buf [BUF_LEN];
+  parser_error(parser, buf, BUF_LEN);
+  printf("%s\n", buf);
+}
+
+int parse (Arena* arena, Tokens* tokens, Expr* res) {
+  STAT_START(start);
+  Parser* parser = parser_new(arena, tokens);
+
+  int pass = parse_expr(parser, new_assoc(RASSOC, 0), res);
+  if (pass && !eof(parser)) pass = push_err(parser, "unexpected '%s'", tok(at(parser)));
+  // the root is the caller's, it never goes through expr_alloc
+  if (pass) expr_meta(res);
+  if (!pass) parser_report(parser);
+
+  parser_delete(parser);
+  STAT_STOP(TIME_PARSE, start);
   return pass;
 }
 
+int parser_done (Parser* parser) {
+  return eof(parser);
+}
+
+int is_decl_beg (TokenType typ) {
+  return 
+    typ == TOK_DEF || 
+    typ == TOK_AXIOM;
+}
+
+int parse_decl_end (Parser* parser) {
+  if (eof(parser) || is_decl_beg(at(parser))) return 1;
+  return push_err(parser, "expected declaration, found '%s'", tok(at(parser)));
+}
+
+//  def name : type := value  |  axiom name : type  |  value
+//  a declaration runs until the next one begins
+int parse_decl (Parser* parser, Decl* res) {
+  memset(res, 0, sizeof(Decl));
+  res->tok = parser->ptr;
+  TokenType kind = at(parser);
+
+  if (!is_decl_beg(kind)) {
+    Expr value = new_expr();
+    if (!parse_expr(parser, new_assoc(RASSOC, 0), &value)) return 0;
+    res->value = parser_alloc(parser, &value, res->tok);
+    return parse_decl_end(parser);
+  }
+
+  eat(parser);
+  if (!expect(parser, TOK_IDENT)) return 0;
+  Span span = tok_span(parser->stream, parser->ptr);
+  res->name = sym_intern(parser->stream->src + span.off, span.len, tok_hash(parser->stream, parser->ptr));
+  eat(parser);
+
+  Expr type = new_expr();
+  if (!try_eat(parser, TOK_COLON)) return 0;
+  int from = parser->ptr;
+  if (!parse_expr(parser, new_assoc(RASSOC, 0), &type)) return 0;
+  res->type = parser_alloc(parser, &type, from);
+
+  if (kind == TOK_DEF) {
+    Expr value = new_expr();
+    if (!try_eat(parser, TOK_DEFINE)) return 0;
+    from = parser->ptr;
+    if (!parse_expr(parser, new_assoc(RASSOC, 0), &value)) return 0;
+    res->value = parser_alloc(parser, &value, from);
+  }
+
+  return parse_decl_end(parser);
+}
+
+//  drops the state of a declaration that failed to parse and moves to
+//  the start of the next one, 'from' is where the failed one began
+void parser_skip (Parser* parser, int from) {
+  hmap_clear(parser->binds);
+  parser->depth = 0;
+  parser->binding = 0;
+
+  if (parser->ptr == from) eat(parser);
+  while (!eof(parser) && !is_decl_beg(at(parser))) eat(parser);
+}
+
+// continues parsing from token 'ptr' with no binders in scope
+void parser_seek (Parser* parser, int ptr) {
+  hmap_clear(parser->binds);
+  parser->depth = 0;
+  parser->binding = 0;
+  parser->ptr = ptr;
+}
+
+//  nested prefixes, parentheses and right operands recurse through the
+//  three below, which move to a heap segment when the stack runs low.
+//  left operands are folded in a loop by parse_expr_infix
+typedef int (*ParseFn) (Parser* parser, Assoc assoc, Expr* res);
+
+typedef struct ParseCall {
+  ParseFn fn;
+  Parser* parser;
+  Assoc assoc;
+  Expr* res;
+  int pass;
+} ParseCall;
+
+static void parse_deep (void* data) {
+  ParseCall* call = data;
+  call->pass = call->fn(call->parser, call->assoc, call->res);
+}
+
+static int parse_segment (ParseFn fn, Parser* parser, Assoc assoc, Expr* res) {
+  ParseCall call = { fn, parser, assoc, res, 0 };
+  deep_run(parse_deep, &call);
+  return call.pass;
+}
+
 int parse_expr (Parser* parser, Assoc assoc, Expr* res) {
+  if (deep_low()) return parse_segment(parse_expr, parser, assoc, res);
   Expr lhs = new_expr(); 
+  int from = parser->ptr;
 
-  switch (at(parser)->type) {
+  switch (at(parser)) {
     case TOK_IDENT: {
-      Token* cur = eat(parser);  
-      int* idx = hmap_get(parser->binds, cur->tok);
+      int cur = eat(parser);  
+      Span span = tok_span(parser->stream, cur);
+      uint32_t hash = tok_hash(parser->stream, cur);
+      lhs.name = sym_intern(parser->stream->src + span.off, span.len, hash);
+      int* level = hmap_get(parser->binds, lhs.name, hash);
 
-      if (idx == NULL) {
+      if (level == NULL) {
         lhs.typ = EXP_FREE;
-        strcpy(lhs.free, cur->tok);
       } else {
         lhs.typ = EXP_TERM;
-        lhs.term.idx = *idx;
-        strcpy(lhs.term.name, cur->tok);
+        lhs.term.idx = parser->depth - 1 - *level;
       }
-
-      lhs.col = cur->col;
-      lhs.row = cur->row;
       break;
     }
     case TOK_ASTERISK: {
-      Token* cur = eat(parser);
+      eat(parser);
       lhs.typ = EXP_KIND;
-      lhs.col = cur->col;
-      lhs.row = cur->row;
       break;
     }
     case TOK_LPARENTH: {
@@ -215,65 +510,49 @@ int parse_expr (Parser* parser, Assoc assoc, Expr* res) {
     }
   }
 
-  Expr* alloc = expr_alloc(&lhs);
-  if (!parse_expr_infix(parser, assoc, alloc, res)) {
-    free(alloc);
-    return 0;
-  } 
-  return 1;
+  Expr* alloc = parser_alloc(parser, &lhs, from);
+  return parse_expr_infix(parser, assoc, alloc, from, res);
 }
 
-int parse_expr_infix (Parser* parser, Assoc assoc, Expr* lhs, Expr* res) {
-  TokenType op = at(parser)->type; 
-  
-  // if lhs is adjacent to 'ident' or '(' then apply
-  if (!parser->binding && is_tok_beg(op)) {
-    op = TOK_APP;
-  } 
-
-  if (!is_infix(op) || expr_assoc(op).bp < assoc_bp(assoc)) {
-    memcpy(res, lhs, sizeof(Expr));
-    free(lhs);
-    return 1;
-  }
-
-  if (op != TOK_APP) eat(parser);
-  
-  switch (op) {    
-    case TOK_COLON: 
-      if (!parse_annot(parser, expr_assoc(op), lhs)) return 0;
-      return parse_expr_infix(parser, assoc, lhs, res);
+//  'from' is the first token of 'lhs', every operator's node starts
+//  where its leftmost operand does
+int parse_expr_infix (Parser* parser, Assoc assoc, Expr* lhs, int from, Expr* res) {
+  for (;;) {
+    TokenType op = at(parser); 
     
-    case TOK_ARROW: {
-      Expr infix = new_expr();
-      if (!parse_arrow(parser, expr_assoc(op), lhs, &infix)) return 0;
-      Expr* alloc = expr_alloc(&infix);
-      if (!parse_expr_infix(parser, assoc, alloc, res)) {
-        free(alloc);
-        return 0;
-      } 
+    // if lhs is adjacent to 'ident' or '(' then apply
+    if (!parser->binding && is_tok_beg(op)) {
+      op = TOK_APP;
+    } 
+
+    if (!is_infix(op) || expr_assoc(op).bp < assoc_bp(assoc)) {
+      memcpy(res, lhs, sizeof(Expr));
       return 1;
     }
+
+    if (op != TOK_APP) eat(parser);
     
-    case TOK_APP: {
-      Expr infix = new_expr(); 
-      if (!parse_app(parser, expr_assoc(op), lhs, &infix)) return 0;
-      
-      Expr* alloc = expr_alloc(&infix);
-      if (!parse_expr_infix(parser, assoc, alloc, res)) {
-        free(alloc);
-        return 0;
-      } else {
-        return 1;
-      }
+    // the result becomes the lhs of the next operator
+    Expr infix = new_expr();
+    switch (op) {    
+      case TOK_COLON: 
+        if (!parse_annot(parser, expr_assoc(op), lhs, &infix)) return 0;
+        break;
+      case TOK_ARROW: 
+        if (!parse_arrow(parser, expr_assoc(op), lhs, &infix)) return 0;
+        break;
+      case TOK_APP: 
+        if (!parse_app(parser, expr_assoc(op), lhs, &infix)) return 0;
+        break;
+      default: 
+        return push_err(parser, "expected infix, found '%s'", tok(op));
     }
-    default: 
-      return push_err(parser, "expected infix, found '%s'", tok(op));
+    lhs = parser_alloc(parser, &infix, from);
   }
 }
 
 int parse_expr_prefix (Parser* parser, Expr* res) {
-  TokenType op = eat(parser)->type; 
+  TokenType op = tok_type(parser->stream, eat(parser)); 
   switch (op) {
     case TOK_LAM: return parse_lam(parser, expr_assoc(TOK_LAM), res);
     case TOK_FORALL: return parse_pi(parser, expr_assoc(TOK_FORALL), res);
@@ -281,14 +560,34 @@ int parse_expr_prefix (Parser* parser, Expr* res) {
   }
 }
 
+//  takes every argument adjacent to 'lhs' at once, so 'f a b c' is
+//  one spine rather than a chain of applications
 int parse_app (Parser* parser, Assoc assoc, Expr* lhs, Expr* res) {
   Expr rhs = new_expr(); 
+  int from = parser->ptr;
   if (!parse_expr(parser, assoc, &rhs)) return 0;
+  Expr* arg = parser_alloc(parser, &rhs, from);
 
-  res->typ = EXP_APP;
-  res->app.lhs = lhs;
-  res->app.rhs = expr_alloc(&rhs);
-  return 1;
+  // most applications take a single argument
+  if (parser->binding || !is_tok_beg(at(parser))) {
+    spine_init(parser->arena, res, lhs, &arg, 1);
+    return 1;
+  }
+
+  ExprStack args;
+  ExprStack_init(&args);
+  ExprStack_push(&args, arg);
+
+  int pass = 1;
+  while (pass && !parser->binding && is_tok_beg(at(parser))) {
+    rhs = new_expr();
+    from = parser->ptr;
+    if ((pass = parse_expr(parser, assoc, &rhs))) ExprStack_push(&args, parser_alloc(parser, &rhs, from));
+  }
+
+  if (pass) spine_init(parser->arena, res, lhs, args.data, args.len);
+  ExprStack_free(&args);
+  return pass;
 }
 
 int parse_arrow (Parser* parser, Assoc assoc, Expr* lhs, Expr* res) {  
@@ -297,130 +596,145 @@ int parse_arrow (Parser* parser, Assoc assoc, Expr* lhs, Expr* res) {
   
   Expr expr = new_expr();
   parser->dummies++;
+  // the unnamed binder still takes an index in the codomain
+  parser->depth++;
 
+  int from = parser->ptr;
   if (!parse_expr(parser, assoc, &rhs)) return 0;
   if (!is_expr_sort(rhs.typ)) return push_err(parser, "cannot from arrow of non-sort rhs term");
 
-  expr.typ = EXP_FREE;
-  expr.annot.typ = ANN_TYPED;
-  format_to("$%d", expr.free, BUF_LEN, parser->dummies-1);
-  expr.annot.ann = lhs;
+  char dummy [BUF_LEN];
+  format_to("$%d", dummy, BUF_LEN, parser->dummies-1);
+  expr.typ = EXP_TERM;
+  expr.name = sym_from(dummy);
+  expr.term.ann = lhs;
   parser->dummies--;
+  parser->depth--;
 
   res->typ = EXP_PI;
-  res->pi.lhs = expr_alloc(&expr);
-  res->pi.rhs = expr_alloc(&rhs);
-  res->pi.dep = 0;
+  res->name = expr.name;
+  res->pi.lhs = expr_alloc(parser->arena, &expr);
+  res->pi.rhs = parser_alloc(parser, &rhs, from);
+  res->dep = 0;
   return 1;
 }
 
-int parse_annot (Parser* parser, Assoc assoc, Expr* lhs) {
+int parse_annot (Parser* parser, Assoc assoc, Expr* lhs, Expr* res) {
   if (!is_expr_term(lhs->typ)) return push_err(parser, "expected term on lhs of annotation");
 
   Expr rhs = new_expr();
+  int from = parser->ptr;
   if (!parse_expr(parser, assoc, &rhs)) return 0;
   if (!is_expr_sort(rhs.typ)) return push_err(parser, "expected sort on rhs on annotation");
   
-  lhs->annot.typ = ANN_TYPED;
-  lhs->annot.ann = expr_alloc(&rhs);
- 
+  memcpy(res, lhs, sizeof(Expr));
+  res->term.ann = parser_alloc(parser, &rhs, from);
   return 1;
 }
 
 int parse_lam (Parser* parser, Assoc assoc, Expr* res) { 
+  if (deep_low()) return parse_segment(parse_lam, parser, assoc, res);
   parser->binding = 1;
   Expr bind = new_expr();
+  int from = parser->ptr;
   if (!parse_expr(parser, new_assoc(RASSOC, 0), &bind)) return 0;
   if (!is_expr_term(bind.typ)) return push_err(parser, "binding non-term as lambda parameter");
-  if (bind.annot.typ == ANN_EMPTY) return push_err(parser, "binding expects annotation");
+  if (bind.term.ann == NULL) return push_err(parser, "binding expects annotation");
 
-  push_bind(parser, &bind);
+  int* prev = push_bind(parser, &bind);
 
   Expr body = new_expr();
-  if (try_eat(parser, TOK_PERIOD)) {
+  int period = try_eat(parser, TOK_PERIOD);
+  int body_from = parser->ptr;
+  if (period) {
     parser->binding = 0;
     if (!parse_expr(parser, assoc, &body)) return 0;
   } else {
     if (!parse_lam(parser, assoc, &body)) return 0;
   }
 
-  rem_bind(parser, &bind);
+  rem_bind(parser, &bind, prev);
   
   res->typ = EXP_LAM;
-  res->lam.lhs = expr_alloc(&bind);
-  res->lam.rhs = expr_alloc(&body);
+  res->name = bind.name;
+  res->lam.lhs = parser_alloc(parser, &bind, from);
+  res->lam.rhs = parser_alloc(parser, &body, body_from);
   return 1;
 }
 
 int parse_pi (Parser* parser, Assoc assoc, Expr* res) { 
+  if (deep_low()) return parse_segment(parse_pi, parser, assoc, res);
   parser->binding = 1;
   Expr bind = new_expr();
+  int from = parser->ptr;
   if (!parse_expr(parser, new_assoc(RASSOC, 0), &bind)) return 0;
   if (!is_expr_term(bind.typ)) return push_err(parser, "binding non-term as lambda parameter");
 
-  push_bind(parser, &bind);
+  int* prev = push_bind(parser, &bind);
 
   Expr body = new_expr();
-  if (try_eat(parser, TOK_PERIOD)) {
+  int period = try_eat(parser, TOK_PERIOD);
+  int body_from = parser->ptr;
+  if (period) {
     parser->binding = 0;
     if (!parse_expr(parser, assoc, &body)) return 0;
   } else {
     if (!parse_pi(parser, assoc, &body)) return 0;
   }
 
-  rem_bind(parser, &bind);
+  rem_bind(parser, &bind, prev);
   
   res->typ = EXP_PI;
-  res->pi.lhs = expr_alloc(&bind);
-  res->pi.rhs = expr_alloc(&body);
-  res->pi.dep = 1;
+  res->name = bind.name;
+  res->pi.lhs = parser_alloc(parser, &bind, from);
+  res->pi.rhs = parser_alloc(parser, &body, body_from);
+  res->dep = 1;
   return 1;
 }
 
-void print_expr (Expr* expr) {
+typedef struct CloneCall {
+  Arena* arena;
+  Expr* expr;
+  Expr* clone;
+} CloneCall;
+
+static void clone_deep (void* data) {
+  CloneCall* call = data;
+  call->clone = expr_clone(call->arena, call->expr);
+}
+
+// deep copies 'expr' into 'arena' so it outlives a reset of its own arena
+Expr* expr_clone (Arena* arena, Expr* expr) {
+  if (deep_low()) {
+    CloneCall call = { arena, expr, NULL };
+    deep_run(clone_deep, &call);
+    return call.clone;
+  }
+
+  // children first, a hash-consing arena may hand back a shared node
+  Expr clone = *expr;
+
   switch (expr->typ) {
-    case EXP_APP:
-      printf("(");
-      print_expr(expr->app.lhs);
-      printf(" ");
-      print_expr(expr->app.rhs);
-      printf(")");
-      break;
-    case EXP_LAM:
-      printf("(λ");
-      print_expr(expr->lam.lhs);
-      printf(".");
-      print_expr(expr->lam.rhs);
-      printf(")");
+    case EXP_TERM:
+    case EXP_FREE:
+      if (expr->term.ann) clone.term.ann = expr_clone(arena, expr->term.ann);
       break;
-    case EXP_PI:
-      if (expr->pi.dep) {
-        printf("(∀");
-        print_expr(expr->pi.lhs);
-        printf(". ");
-        print_expr(expr->pi.rhs);
-        printf(")");
-      } else {
-        printf("(");
-        print_expr(expr->pi.lhs->annot.ann);
-        printf("->");
-        print_expr(expr->pi.rhs);
-        printf(")");
+    case EXP_SPINE:
+      clone.spine.nodes = arena_alloc(arena, (expr->spine.len + 1) * sizeof(Expr*));
+      for (int i = 0; i <= expr->spine.len; i++) {
+        clone.spine.nodes[i] = expr_clone(arena, expr->spine.nodes[i]);
       }
       break;
-    case EXP_KIND:
-      printf("*");
+    case EXP_LAM:
+      clone.lam.lhs = expr_clone(arena, expr->lam.lhs);
+      clone.lam.rhs = expr_clone(arena, expr->lam.rhs);
       break;
-    case EXP_TERM: 
-      printf("%s", expr->term.name);
-      //printf("#%d", expr->term.idx);
+    case EXP_PI:
+      clone.pi.lhs = expr_clone(arena, expr->pi.lhs);
+      clone.pi.rhs = expr_clone(arena, expr->pi.rhs);
       break;
-    case EXP_FREE:
-      printf("%s", expr->free);
+    default:
       break;
-  }  
-  if (expr->annot.typ == ANN_TYPED) {
-    printf(": ");
-    print_expr(expr->annot.ann);
   }
+  return expr_alloc(arena, &clone);
 }
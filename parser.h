@@ -3,6 +3,8 @@
 
 #include "common.h"
 #include "lexer.h"
+#include "arena.h"
+#include "symtab.h"
 
 typedef struct Parser Parser;
 typedef struct Assoc Assoc;
@@ -11,7 +13,6 @@ typedef struct Type Type;
 typedef struct Kind Kind;
 typedef struct Expr Expr;
 typedef struct Sort Sort;
-typedef struct Annot Annot;
 
 typedef struct Type {
   union {
@@ -27,64 +28,137 @@ typedef struct Kind {
   };
 } Kind;
 
-typedef enum AnnotType {
-  ANN_EMPTY,
-  ANN_TYPED,
-} AnnotType;
-
-typedef struct Annot {
-  AnnotType typ;
-  union {
-    EMPTY empty;
-    Expr* ann;
-  };
-} Annot;
-
 typedef enum ExprType {
   EXP_FREE,
   EXP_TERM,
   EXP_KIND,
-  EXP_APP,
+  EXP_SPINE,
   EXP_LAM,
   EXP_PI,
 } ExprType;
 
+// node was interned by a HashCons and is unique
+#define EXPR_SHARED 1
+// 'fv' may have a bit no free index accounts for, see expr_meta
+#define EXPR_FV_LOOSE 2
+
+//  ______________________________
+// | typ | dep | flags | name     |  8 bytes
+// |------------------------------|
+// | idx, ann / len, nodes / l, r | 16 bytes
+// |------------------------------|
+// | hash  | bound | size  | fv   | 16 bytes
+// |------------------------------|
+// | low   |                      |  8 bytes
+//  ------------------------------
+//  an application is a spine, 'nodes' holds its head followed by its
+//  'len' arguments in order. the head is never itself a spine
 typedef struct Expr {
-  int row;
-  int col;
-
-  ExprType typ;
-  Annot annot;
+  uint8_t typ;
+  uint8_t dep;
+  uint8_t flags;
+  Sym name;
 
   union {
-    struct { char name[BUF_LEN]; int idx; } term;
-    char free[BUF_LEN];
-    struct { Expr* lhs; Expr* rhs; } app;
+    struct { int idx; Expr* ann; } term;
+    struct { int len; Expr** nodes; } spine;
     struct { Expr* lhs; Expr* rhs; } lam;
-    struct { Expr* lhs; Expr* rhs; int dep; } pi;
+    struct { Expr* lhs; Expr* rhs; } pi;
   };
+
+  // filled in from the children by expr_meta, see there
+  uint32_t hash;
+  int bound;
+  uint32_t size;
+  uint32_t fv;
+  int low;
 } Expr;
 
-int parse (VEC(Token) tokens, Expr* res);
+// bits of 'fv', free index i sets bit i - 'low' modulo this
+#define EXPR_FV_BITS 32
+
+//  0 when 'idx' is certainly not free in 'expr', else it may be. exact
+//  when the free indices fit in the bits from 'low' on, as then none 
+//  share one, however deep the term sits
+static inline int expr_has_free (Expr* expr, int idx) {
+  if (idx < expr->low || idx >= expr->bound) return 0;
+  return (expr->fv >> ((idx - expr->low) % EXPR_FV_BITS)) & 1;
+}
+
+static inline int expr_fv_exact (Expr* expr) {
+  return !(expr->flags & EXPR_FV_LOOSE) && expr->bound - expr->low <= EXPR_FV_BITS;
+}
+
+// pending nodes of a traversal kept off the native stack
+SVEC_DEFINE(ExprStack, Expr*, 32)
+
+// a parsed node and its first token
+typedef struct Where {
+  Expr* expr;
+  int tok;
+} Where;
+
+VEC_DEFINE(WhereVec, Where)
+
+//  top-level declaration, 'def name : type := value' or 'axiom name : type'.
+//  a bare expression has neither name nor type. 'tok' is its first token
+typedef struct Decl {
+  Sym name;
+  Expr* type;
+  Expr* value;
+  int tok;
+} Decl;
+
+int parse (Arena* arena, Tokens* tokens, Expr* res);
+
+Parser* parser_new (Arena* arena, Tokens* tokens);
+void parser_delete (Parser* parser);
+void parser_report (Parser* parser);
+void parser_error  (Parser* parser, char* buf, int len);
+const char* parser_message (Parser* parser, int* row, int* col);
+void parser_skip   (Parser* parser, int from);
+void parser_seek   (Parser* parser, int ptr);
+int parser_done (Parser* parser);
+
+//  notes in 'where' the first token of each node parsed from now on,
+//  for diagnostics that point into a term. 'where' is the caller's
+void parser_track (Parser* parser, WhereVec* where);
+//  the first token of a tracked node, -1 if it was not noted. nodes are
+//  only looked up once something failed, so they are found by a scan
+int parser_where (Parser* parser, Expr* expr);
+
+int parse_decl (Parser* parser, Decl* res);
+int is_decl_beg (TokenType typ);
 
 int is_infix (TokenType typ);
 int is_prefix (TokenType typ);
 
+int is_expr_term (ExprType typ);
 int is_expr_sort (ExprType typ);
 int is_tok_beg (TokenType typ);
 
 int parse_app   (Parser* parser, Assoc assoc, Expr* lhs, Expr* res);
 int parse_arrow (Parser* parser, Assoc assoc, Expr* lhs, Expr* res);
-int parse_annot (Parser* parser, Assoc assoc, Expr* lhs);
+int parse_annot (Parser* parser, Assoc assoc, Expr* lhs, Expr* res);
 int parse_lam   (Parser* parser, Assoc assoc, Expr* res);
 int parse_pi    (Parser* parser, Assoc assoc, Expr* res);
 
 int parse_expr (Parser* parser, Assoc assoc, Expr* res);
-int parse_expr_infix (Parser* parser, Assoc assoc, Expr* lhs, Expr* res);
+int parse_expr_infix (Parser* parser, Assoc assoc, Expr* lhs, int from, Expr* res);
 int parse_expr_prefix (Parser* parser, Expr* res);
 Assoc expr_assoc (TokenType typ);
 
+Expr* expr_alloc (Arena* arena, Expr* expr);
+void expr_meta (Expr* expr);
+
+//  applies 'head' to 'args', which are copied. a spine head has its
+//  arguments moved in front of 'args'
+Expr* spine_new (Arena* arena, Expr* head, Expr** args, int len);
+void spine_init (Arena* arena, Expr* res, Expr* head, Expr** args, int len);
+Expr* expr_ann (Expr* expr);
+Expr* expr_bare (Arena* arena, Expr* expr);
+Expr* expr_clone (Arena* arena, Expr* expr);
+
 void print_type (Type* type);
-void print_expr (Expr* expr);
 
 #endif
@@ -0,0 +1,169 @@
+#include "pool.h"
+#include "stats.h"
+#include "deep.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct Worker {
+  Pool* pool;
+  int id;
+} Worker;
+
+int deque_pop (Deque* deque, int* task) {
+  pthread_mutex_lock(&deque->lock);
+  int found = deque->tail > deque->head;
+  if (found) *task = deque->tasks[--deque->tail];
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+int deque_steal (Deque* deque, int* task) {
+  pthread_mutex_lock(&deque->lock);
+  int found = deque->tail > deque->head;
+  if (found) *task = deque->tasks[deque->head++];
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+void deque_push (Deque* deque, int task) {
+  pthread_mutex_lock(&deque->lock);
+  if (deque->head > 0 && deque->head == deque->tail) {
+    deque->head = 0;
+    deque->tail = 0;
+  }
+  if (deque->tail == deque->cap) {
+    deque->cap *= 2;
+    deque->tasks = realloc(deque->tasks, deque->cap * sizeof(int));
+  }
+  deque->tasks[deque->tail++] = task;
+  pthread_mutex_unlock(&deque->lock);
+}
+
+// own deque first, newest task first, then the oldest task of a victim
+int pool_take (Pool* pool, int id, int* task) {
+  if (deque_pop(&pool->deques[id], task)) return 1;
+  for (int i = 1; i < pool->workers; i++) {
+    if (deque_steal(&pool->deques[(id + i) % pool->workers], task)) return 1;
+  }
+  return 0;
+}
+
+void* pool_loop (void* arg) {
+  Worker* worker = arg;
+  Pool* pool = worker->pool;
+  int task;
+  deep_init();
+
+  for (;;) {
+    if (atomic_load(&pool->queued) > 0 && pool_take(pool, worker->id, &task)) {
+      atomic_fetch_sub(&pool->queued, 1);
+      pool->fn(pool, worker->id, task, pool->data);
+
+      pthread_mutex_lock(&pool->lock);
+      pool->done++;
+      if (pool->waiting) pthread_cond_broadcast(&pool->idle);
+      pthread_mutex_unlock(&pool->lock);
+      continue;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load(&pool->queued) == 0 && !pool->stop) {
+      pool->sleeping++;
+      pthread_cond_wait(&pool->wake, &pool->lock);
+      pool->sleeping--;
+    }
+    int stop = pool->stop;
+    pthread_mutex_unlock(&pool->lock);
+    if (stop) break;
+  }
+
+  STAT_FLUSH();
+  deep_release();
+  free(worker);
+  return NULL;
+}
+
+Pool* pool_new (int workers, task_fn fn, void* data) {
+  Pool* pool = malloc(sizeof(Pool));
+  pool->threads = malloc(workers * sizeof(pthread_t));
+  pool->deques = malloc(workers * sizeof(Deque));
+  pool->workers = workers;
+  pool->fn = fn;
+  pool->data = data;
+  atomic_init(&pool->queued, 0);
+  pool->done = 0;
+  pool->stop = 0;
+  pool->sleeping = 0;
+  pool->waiting = 0;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->idle, NULL);
+
+  for (int i = 0; i < workers; i++) {
+    Deque* deque = &pool->deques[i];
+    pthread_mutex_init(&deque->lock, NULL);
+    deque->cap = 64;
+    deque->tasks = malloc(deque->cap * sizeof(int));
+    deque->head = 0;
+    deque->tail = 0;
+  }
+
+  for (int i = 0; i < workers; i++) {
+    Worker* worker = malloc(sizeof(Worker));
+    worker->pool = pool;
+    worker->id = i;
+    pthread_create(&pool->threads[i], NULL, pool_loop, worker);
+  }
+  return pool;
+}
+
+void pool_delete (Pool* pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int i = 0; i < pool->workers; i++) {
+    pthread_join(pool->threads[i], NULL);
+    pthread_mutex_destroy(&pool->deques[i].lock);
+    free(pool->deques[i].tasks);
+  }
+
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->wake);
+  pthread_cond_destroy(&pool->idle);
+  free(pool->deques);
+  free(pool->threads);
+  free(pool);
+}
+
+void pool_push (Pool* pool, int worker, int task) {
+  deque_push(&pool->deques[worker % pool->workers], task);
+  atomic_fetch_add(&pool->queued, 1);
+
+  pthread_mutex_lock(&pool->lock);
+  if (pool->sleeping) pthread_cond_signal(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_wait (Pool* pool, int total) {
+  pthread_mutex_lock(&pool->lock);
+  pool->waiting++;
+  while (pool->done < total) pthread_cond_wait(&pool->idle, &pool->lock);
+  pool->waiting--;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+// every finished task wakes the waiters, a flag set by one is seen then
+void pool_wait_flag (Pool* pool, atomic_int* flag) {
+  pthread_mutex_lock(&pool->lock);
+  pool->waiting++;
+  while (!atomic_load(flag)) pthread_cond_wait(&pool->idle, &pool->lock);
+  pool->waiting--;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+int pool_cores () {
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  return cores > 0 ? cores : 1;
+}
@@ -0,0 +1,53 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+typedef struct Pool Pool;
+
+// runs task 'task' on thread 'worker', which may push follow-up tasks
+typedef void (*task_fn) (Pool* pool, int worker, int task, void* data);
+
+//  one deque per worker, the owner pushes and pops at the tail and
+//  idle workers steal from the head of the others
+typedef struct Deque {
+  pthread_mutex_t lock;
+  int* tasks;
+  int head;
+  int tail;
+  int cap;
+} Deque;
+
+typedef struct Pool {
+  pthread_t* threads;
+  Deque* deques;
+  int workers;
+  task_fn fn;
+  void* data;
+
+  // tasks waiting in some deque, idle workers sleep while it is zero
+  atomic_int queued;
+  int done;
+  int stop;
+  // threads blocked on 'wake' and 'idle', nobody is signalled while zero
+  int sleeping;
+  int waiting;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t idle;
+} Pool;
+
+Pool* pool_new (int workers, task_fn fn, void* data);
+void pool_delete (Pool* pool);
+
+// 'worker' is the calling worker, or any index when called from outside
+void pool_push (Pool* pool, int worker, int task);
+// blocks until 'total' tasks have finished
+void pool_wait (Pool* pool, int total);
+// blocks until a task has set 'flag', which it must do before it returns
+void pool_wait_flag (Pool* pool, atomic_int* flag);
+
+int pool_cores ();
+
+#endif
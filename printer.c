@@ -0,0 +1,300 @@
+#include "printer.h"
+#include "strop.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+int print_width = 0;
+
+void sink_file (void* data, const char* bytes, size_t len) {
+  fwrite(bytes, 1, len, (FILE*)data);
+}
+
+void sink_fd (void* data, const char* bytes, size_t len) {
+  int fd = (int)(intptr_t)data;
+  while (len > 0) {
+    ssize_t n = write(fd, bytes, len);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    bytes += n;
+    len -= n;
+  }
+}
+
+void printer_init (Printer* p, sink_fn sink, void* data, int width) {
+  PrintBuf_init(&p->buf);
+  PrintStack_init(&p->todo);
+  NameStack_init(&p->names);
+  p->sink = sink;
+  p->data = data;
+  p->width = width;
+  p->col = 0;
+}
+
+void printer_free (Printer* p) {
+  PrintBuf_free(&p->buf);
+  PrintStack_free(&p->todo);
+  NameStack_free(&p->names);
+}
+
+void printer_flush (Printer* p) {
+  if (p->sink == NULL) return;
+  if (p->buf.len > 0) p->sink(p->data, p->buf.data, p->buf.len);
+  PrintBuf_clear(&p->buf);
+}
+
+static void print_spill (Printer* p) {
+  if (p->buf.len >= PRINT_FLUSH) printer_flush(p);
+}
+
+// columns count code points, so 'λ' and '∀' take one each
+static void print_advance (Printer* p, const char* bytes, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    if (bytes[i] == '\n') p->col = 0;
+    else if ((bytes[i] & 0xc0) != 0x80) p->col++;
+  }
+}
+
+void print_bytes (Printer* p, const char* bytes, size_t len) {
+  PrintBuf_extend(&p->buf, bytes, (int)len);
+  print_advance(p, bytes, len);
+}
+
+void print_str (Printer* p, const char* str) {
+  print_bytes(p, str, strlen(str));
+  print_spill(p);
+}
+
+// formats straight into the buffer, growing it once if it falls short
+void print_fmt (Printer* p, const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int room = p->buf.cap - p->buf.len;
+  int len = vsnprintf(p->buf.data + p->buf.len, room, fmt, args);
+  va_end(args);
+
+  if (len >= room) {
+    PrintBuf_reserve(&p->buf, p->buf.len + len + 1);
+    va_start(args, fmt);
+    vsnprintf(p->buf.data + p->buf.len, len + 1, fmt, args);
+    va_end(args);
+  }
+
+  print_advance(p, p->buf.data + p->buf.len, len);
+  p->buf.len += len;
+  print_spill(p);
+}
+
+#define NAME_DIGITS 16
+
+// writes the suffix to 'digits', which holds NAME_DIGITS, and returns its length
+static int name_digits (PrintName name, char* digits) {
+  digits[0] = '\0';
+  if (name.suffix != 0) format_to("%d", digits, NAME_DIGITS, name.suffix);
+  return strlen(digits);
+}
+
+static PrintName name_new (Sym sym, int suffix) {
+  PrintName name = { sym, suffix, sym_hash_of(sym) };
+  if (suffix == 0) return name;
+
+  char digits [NAME_DIGITS];
+  name_digits(name, digits);
+  for (char* c = digits; *c; c++) name.hash = SYM_HASH_STEP(name.hash, *c);
+  return name;
+}
+
+// whether both print the same text, 'x' numbered 12 is also 'x1' numbered 2
+static int name_same (PrintName a, PrintName b) {
+  if (a.hash != b.hash) return 0;
+  if (a.suffix == b.suffix) return a.sym == b.sym;
+
+  char da [NAME_DIGITS], db [NAME_DIGITS];
+  int la = sym_len(a.sym), lb = sym_len(b.sym);
+  int len = la + name_digits(a, da);
+  if (len != lb + name_digits(b, db)) return 0;
+
+  const char* sa = sym_name(a.sym);
+  const char* sb = sym_name(b.sym);
+  for (int i = 0; i < len; i++) {
+    char ca = i < la ? sa[i] : da[i - la];
+    char cb = i < lb ? sb[i] : db[i - lb];
+    if (ca != cb) return 0;
+  }
+  return 1;
+}
+
+static int name_taken (NameStack* names, PrintName name) {
+  for (int i = 0; i < names->len; i++) {
+    if (name_same(names->data[i], name)) return 1;
+  }
+  return 0;
+}
+
+//  a binder keeps its name unless another in scope prints the same, 
+//  then it is numbered by its depth or the first number past it that 
+//  is free. the number is printed after the name rather than interned
+static PrintName print_name (NameStack* names, Sym sym) {
+  PrintName name = name_new(sym, 0);
+  for (int suffix = names->len; name_taken(names, name); suffix++) {
+    name = name_new(sym, suffix);
+  }
+  return name;
+}
+
+static void print_var (Printer* p, PrintName name) {
+  print_bytes(p, sym_name(name.sym), sym_len(name.sym));
+  if (name.suffix == 0) return;
+
+  char digits [NAME_DIGITS];
+  print_bytes(p, digits, name_digits(name, digits));
+}
+
+static inline void print_push (Printer* p, PrintOp op, int indent, Expr* expr) {
+  PrintStack_push(&p->todo, (PrintItem){ .op = op, .indent = indent, .expr = expr });
+}
+
+static inline void print_text (Printer* p, const char* text) {
+  PrintStack_push(&p->todo, (PrintItem){ .op = PRINT_TEXT, .text = text });
+}
+
+// nesting stops indenting past half the width, deep terms would be all spaces
+static inline int print_indent (Printer* p, int indent) {
+  return indent + 2 <= p->width / 2 ? indent + 2 : indent;
+}
+
+//  writes what comes before the first child of 'expr' and queues the
+//  rest, children last first. a broken spine puts each argument on a
+//  line of its own and a broken binder puts its body on the next
+static void print_node (Printer* p, Expr* expr, int indent, int flat) {
+  PrintOp child = flat ? PRINT_FLAT : PRINT_EXPR;
+  NameStack* names = &p->names;
+  int inner = print_indent(p, indent);
+
+  switch (expr->typ) {
+    case EXP_SPINE:
+      print_bytes(p, "(", 1);
+      print_text(p, ")");
+      for (int i = expr->spine.len; i > 0; i--) {
+        print_push(p, child, inner, expr->spine.nodes[i]);
+        if (flat) print_text(p, " ");
+        else print_push(p, PRINT_LINE, inner, NULL);
+      }
+      print_push(p, child, indent, expr->spine.nodes[0]);
+      break;
+    case EXP_LAM:
+    case EXP_PI: {
+      Expr* bind = expr->lam.lhs;
+      int arrow = expr->typ == EXP_PI && !expr->dep;
+      // an arrow's binder is never shown, so it is not worth the scan
+      PrintName name = arrow ? name_new(bind->name, 0) : print_name(names, bind->name);
+
+      const char* open = expr->typ == EXP_LAM ? "(λ" : arrow ? "(" : "(∀";
+      print_bytes(p, open, strlen(open));
+      if (!arrow) {
+        print_var(p, name);
+        print_bytes(p, ": ", 2);
+      }
+
+      print_text(p, ")");
+      print_push(p, PRINT_UNBIND, 0, NULL);
+      print_push(p, child, inner, expr->lam.rhs);
+      PrintStack_push(&p->todo, (PrintItem){ .op = PRINT_BIND, .name = name });
+      if (!flat) print_push(p, PRINT_LINE, inner, NULL);
+      print_text(p, expr->typ == EXP_LAM ? "." : arrow ? "->" : flat ? ". " : ".");
+      print_push(p, child, indent, bind->term.ann);
+      break;
+    }
+    case EXP_KIND:
+      print_bytes(p, "*", 1);
+      break;
+    case EXP_TERM:
+    case EXP_FREE: {
+      PrintName name = { expr->name, 0, 0 };
+      int idx = expr->term.idx;
+      if (expr->typ == EXP_TERM && idx < names->len) name = names->data[names->len - 1 - idx];
+
+      print_var(p, name);
+      if (expr->term.ann) {
+        print_push(p, child, indent, expr->term.ann);
+        print_text(p, ": ");
+      }
+      break;
+    }
+  }
+}
+
+//  variables are printed with the name of the binder their index points
+//  to, stored names may be stale once nodes are shared or substituted.
+//  with a width, each node is first tried on one line and printed
+//  broken when that overflows, the attempt is undone by truncating the
+//  buffer, which is why nothing is flushed in the middle of one
+void print_term (Printer* p, Expr* expr) {
+  PrintStack* todo = &p->todo;
+  int base = todo->len;
+  print_push(p, p->width > 0 ? PRINT_EXPR : PRINT_FLAT, p->col, expr);
+
+  // the node being tried on one line, with what to restore if it fails
+  PrintItem trial = { 0 };
+  int trying = 0;
+  int depth = 0;
+  int mark = 0;
+  int col = 0;
+  int bound = 0;
+
+  while (todo->len > base) {
+    if (!trying) print_spill(p);
+    PrintItem item = PrintStack_pop(todo);
+
+    switch (item.op) {
+      case PRINT_TEXT:
+        print_bytes(p, item.text, strlen(item.text));
+        break;
+      case PRINT_LINE:
+        print_bytes(p, "\n", 1);
+        for (int i = 0; i < item.indent; i++) print_bytes(p, " ", 1);
+        break;
+      case PRINT_BIND:
+        NameStack_push(&p->names, item.name);
+        break;
+      case PRINT_UNBIND:
+        NameStack_pop(&p->names);
+        break;
+      case PRINT_EXPR:
+        trial = item;
+        trying = 1;
+        depth = todo->len;
+        mark = p->buf.len;
+        col = p->col;
+        bound = p->names.len;
+        print_node(p, item.expr, item.indent, 1);
+        break;
+      case PRINT_FLAT:
+        print_node(p, item.expr, item.indent, 1);
+        break;
+    }
+
+    if (!trying) continue;
+    if (p->col > p->width) {
+      p->buf.len = mark;
+      p->col = col;
+      p->names.len = bound;
+      todo->len = depth;
+      trying = 0;
+      print_node(p, trial.expr, trial.indent, 0);
+    }
+    else if (todo->len == depth) trying = 0;
+  }
+}
+
+void print_expr (Expr* expr) {
+  Printer p;
+  printer_init(&p, sink_file, stdout, print_width);
+  print_term(&p, expr);
+  printer_flush(&p);
+  printer_free(&p);
+}
@@ -0,0 +1,82 @@
+#ifndef __PRINTER_H__
+#define __PRINTER_H__
+
+#include "parser.h"
+#include <stdint.h>
+
+// buffered bytes past which a printer hands them to its sink
+#define PRINT_FLUSH 65536
+
+// receives each flushed run of bytes, 'data' is the sink's own
+typedef void (*sink_fn) (void* data, const char* bytes, size_t len);
+
+// 'data' is a FILE*
+void sink_file (void* data, const char* bytes, size_t len);
+// 'data' is a file descriptor cast with (void*)(intptr_t)
+void sink_fd   (void* data, const char* bytes, size_t len);
+
+typedef enum PrintOp {
+  PRINT_EXPR,
+  PRINT_FLAT,
+  PRINT_TEXT,
+  PRINT_LINE,
+  PRINT_BIND,
+  PRINT_UNBIND,
+} PrintOp;
+
+//  a binder's name as printed, 'suffix' is appended unless zero and
+//  'hash' is that of the printed text, which is what must not repeat
+typedef struct PrintName {
+  Sym sym;
+  int suffix;
+  uint32_t hash;
+} PrintName;
+
+//  pending output of a term, a node in the given layout, a string, a
+//  line break followed by 'indent' spaces or a change to the binders
+typedef struct PrintItem {
+  uint8_t op;
+  int indent;
+  union {
+    Expr* expr;
+    const char* text;
+    PrintName name;
+  };
+} PrintItem;
+
+SVEC_DEFINE(PrintBuf, char, 512)
+SVEC_DEFINE(PrintStack, PrintItem, 64)
+// binder names in scope while printing, innermost last
+SVEC_DEFINE(NameStack, PrintName, 16)
+
+//  collects output in 'buf' and passes it on to 'sink' once flushed or
+//  past PRINT_FLUSH. without a sink the bytes stay in 'buf' for the
+//  caller. a 'width' above zero breaks terms that overflow the line,
+//  else each is printed on one. lives in place, like its vectors
+typedef struct Printer {
+  PrintBuf buf;
+  PrintStack todo;
+  NameStack names;
+  sink_fn sink;
+  void* data;
+  int width;
+  // code points since the last line break
+  int col;
+} Printer;
+
+// line width of types printed to stdout, zero for no limit
+extern int print_width;
+
+void printer_init (Printer* p, sink_fn sink, void* data, int width);
+void printer_free (Printer* p);
+void printer_flush (Printer* p);
+
+void print_bytes (Printer* p, const char* bytes, size_t len);
+void print_str   (Printer* p, const char* str);
+void print_fmt   (Printer* p, const char* fmt, ...);
+void print_term  (Printer* p, Expr* expr);
+
+// prints to stdout, handing it the whole term at once
+void print_expr (Expr* expr);
+
+#endif
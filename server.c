@@ -0,0 +1,415 @@
+#define _GNU_SOURCE
+#include "server.h"
+#include "driver.h"
+#include "validate.h"
+#include "nbe.h"
+#include "pool.h"
+#include "ccache.h"
+#include "source.h"
+#include "object.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// events taken per wait and bytes asked for per read
+#define SERVE_EVENTS 64
+#define SERVE_READ   4096
+// connections are tracked by descriptor, up to the limit or this many
+#define SERVE_CONNS  65536
+
+VEC_DEFINE(LineBuf, char)
+
+//  a client. the loop owns it while it waits for a whole line, a worker
+//  from then on until every line in is answered and it is re-armed, so
+//  one thread at a time ever touches it
+typedef struct Conn {
+  int fd;
+  LineBuf in;
+  // the client has closed its end, what it sent is answered first
+  int eof;
+  // a write failed, nothing more is sent
+  int broken;
+  //  stored by the worker before it re-arms and loaded by the loop on
+  //  the next event. epoll already orders the two, this is what makes
+  //  the worker's writes visible to the loop as far as C is concerned
+  atomic_int armed;
+} Conn;
+
+//  state confined to one worker and kept between requests. the caches
+//  are cleared after each, a request's own declarations may change what
+//  a name means in the next
+typedef struct ServeSlot {
+  Arena* scratch;
+  TypeCache* cache;
+} ServeSlot;
+
+typedef struct Server {
+  int epoll;
+  int listen;
+  //  by descriptor, the table is never resized. a worker empties the
+  //  slot of a connection it closes, which the loop may then refill
+  _Atomic(Conn*)* conns;
+  int nconns;
+  int next;
+  Globals* globals;
+  ServeSlot* slots;
+  Pool* pool;
+} Server;
+
+static volatile sig_atomic_t serving = 1;
+
+static void stop_serving (int sig) {
+  (void)sig;
+  serving = 0;
+}
+
+static int unix_addr (const char* path, struct sockaddr_un* addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr->sun_path)) {
+    printf("socket path '%s' is too long\n", path);
+    return 0;
+  }
+  strcpy(addr->sun_path, path);
+  return 1;
+}
+
+//  the socket stays non-blocking for the loop, a worker that fills it
+//  waits until the client has read enough
+static void sink_conn (void* data, const char* bytes, size_t len) {
+  Conn* conn = data;
+  while (len > 0 && !conn->broken) {
+    ssize_t n = send(conn->fd, bytes, len, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        struct pollfd ready = { conn->fd, POLLOUT, 0 };
+        poll(&ready, 1, -1);
+        continue;
+      }
+      conn->broken = 1;
+      return;
+    }
+    bytes += n;
+    len -= n;
+  }
+}
+
+// the store is the last the caller does with the connection
+static void conn_arm (Server* server, Conn* conn, int op) {
+  int fd = conn->fd;
+  struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT, .data.fd = fd };
+  atomic_store_explicit(&conn->armed, 1, memory_order_release);
+  epoll_ctl(server->epoll, op, fd, &ev);
+}
+
+// the slot is emptied first, the descriptor may be reused once closed
+static void conn_close (Server* server, Conn* conn) {
+  atomic_store_explicit(&server->conns[conn->fd], NULL, memory_order_release);
+  close(conn->fd);
+  LineBuf_free(&conn->in);
+  free(conn);
+}
+
+// checks declarations against the server's in a table of their own
+static int serve_decls (Server* server, ServeSlot* slot, const char* src, size_t len, Printer* out) {
+  Globals* globals = globals_new();
+  globals->base = server->globals;
+  slot->scratch->globals = globals;
+
+  Tokens toks = tokens_stream(src, len);
+  int failed = check_decls(slot->scratch, slot->cache, &toks, out);
+  tokens_free(&toks);
+
+  slot->scratch->globals = NULL;
+  globals_delete(globals);
+  return failed;
+}
+
+static int serve_expr (Server* server, ServeSlot* slot, const char* src, int normalize, Printer* out) {
+  Arena* arena = slot->scratch;
+  arena->globals = server->globals;
+  Tokens toks = tokens_full(src, strlen(src));
+  Parser* parser = parser_new(arena, &toks);
+  Expr* type = NULL;
+  Decl decl;
+
+  if (!parse_decl(parser, &decl)) {
+    char error [BUF_LEN];
+    parser_error(parser, error, BUF_LEN);
+    print_fmt(out, "%s\n", error);
+  }
+  else if (decl.name || !parser_done(parser)) print_str(out, "expected one expression\n");
+  else if ((type = check_decl(arena, slot->cache, &decl)) == NULL) print_str(out, "ill-typed\n");
+  else {
+    print_term(out, normalize ? nbe_normalize(arena, NULL, 0, decl.value) : type);
+    print_str(out, "\n");
+  }
+
+  parser_delete(parser);
+  tokens_free(&toks);
+  if (slot->cache) tcache_clear(slot->cache);
+  if (arena->conv) ccache_clear(arena->conv);
+  arena_reset(arena);
+  arena->globals = NULL;
+  return type == NULL;
+}
+
+// answers one request, 'line' is NUL terminated in place of its newline
+static void serve_line (Server* server, ServeSlot* slot, char* line, Printer* out) {
+  size_t len = strlen(line);
+  if (len > 0 && line[len - 1] == '\r') line[--len] = '\0';
+
+  char* arg = strchr(line, ' ');
+  if (arg) *arg++ = '\0';
+  else arg = line + len;
+
+  int failed = 1;
+  if (strcmp(line, "infer") == 0) failed = serve_expr(server, slot, arg, 0, out);
+  else if (strcmp(line, "normalize") == 0) failed = serve_expr(server, slot, arg, 1, out);
+  else if (strcmp(line, "check") == 0) failed = serve_decls(server, slot, arg, strlen(arg), out);
+  else if (strcmp(line, "file") == 0) {
+    Source src;
+    if (source_map(arg, &src)) {
+      failed = serve_decls(server, slot, src.data, src.len, out);
+      source_unmap(&src);
+    }
+    else print_fmt(out, "cannot open '%s'\n", arg);
+  }
+  else print_fmt(out, "unknown request '%s'\n", line);
+
+  print_fmt(out, "= %d\n", failed);
+}
+
+//  answers every whole line the connection has in, in order, with one
+//  write for all of them unless they fill the printer
+static void serve_task (Pool* pool, int worker, int fd, void* data) {
+  (void)pool;
+  Server* server = data;
+  Conn* conn = atomic_load_explicit(&server->conns[fd], memory_order_relaxed);
+  ServeSlot* slot = &server->slots[worker];
+
+  Printer out;
+  printer_init(&out, sink_conn, conn, print_width);
+  int done = 0;
+  char* end;
+  while ((end = memchr(conn->in.data + done, '\n', conn->in.len - done))) {
+    *end = '\0';
+    serve_line(server, slot, conn->in.data + done, &out);
+    done = end + 1 - conn->in.data;
+  }
+  printer_flush(&out);
+  printer_free(&out);
+
+  conn->in.len -= done;
+  memmove(conn->in.data, conn->in.data + done, conn->in.len);
+  if (conn->eof || conn->broken) conn_close(server, conn);
+  else conn_arm(server, conn, EPOLL_CTL_MOD);
+}
+
+static void serve_accept (Server* server) {
+  for (;;) {
+    int fd = accept4(server->listen, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    if (fd >= server->nconns) {
+      close(fd);
+      continue;
+    }
+
+    Conn* conn = malloc(sizeof(Conn));
+    conn->fd = fd;
+    LineBuf_init(&conn->in, 0);
+    conn->eof = 0;
+    conn->broken = 0;
+    atomic_init(&conn->armed, 0);
+    atomic_store_explicit(&server->conns[fd], conn, memory_order_relaxed);
+    conn_arm(server, conn, EPOLL_CTL_ADD);
+  }
+}
+
+//  reads what the client sent so far and hands the connection to a
+//  worker once a whole line is in. the bytes before were already
+//  searched, a worker leaves no whole line behind
+static void serve_read (Server* server, Conn* conn) {
+  atomic_load_explicit(&conn->armed, memory_order_acquire);
+  int from = conn->in.len;
+  while (conn->in.len <= SERVE_LINE) {
+    LineBuf_reserve(&conn->in, conn->in.len + SERVE_READ);
+    ssize_t n = read(conn->fd, conn->in.data + conn->in.len, conn->in.cap - conn->in.len);
+    if (n > 0) conn->in.len += n;
+    else if (n < 0 && errno == EINTR) continue;
+    else {
+      conn->eof = n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+      break;
+    }
+  }
+
+  // the last request may end with the stream instead of a newline
+  int whole = memchr(conn->in.data + from, '\n', conn->in.len - from) != NULL;
+  if (!whole && conn->eof && conn->in.len > 0 && conn->in.len <= SERVE_LINE) {
+    LineBuf_push(&conn->in, '\n');
+    whole = 1;
+  }
+
+  if (whole) {
+    server->next = (server->next + 1) % server->pool->workers;
+    pool_push(server->pool, server->next, conn->fd);
+  }
+  else if (conn->eof || conn->in.len > SERVE_LINE) conn_close(server, conn);
+  else conn_arm(server, conn, EPOLL_CTL_MOD);
+}
+
+//  ________________________________________________________________
+// | loop    | waits on the socket, accepts and reads whole lines     |
+// | workers | answer a connection's lines and hand it back to 'loop' |
+//  ----------------------------------------------------------------
+int server_run (const char* path, Globals* globals, int workers, size_t cache) {
+  struct sockaddr_un addr;
+  if (!unix_addr(path, &addr)) return 1;
+
+  // a socket left behind by a server that is gone would fail the bind
+  unlink(path);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+    printf("cannot listen on '%s'\n", path);
+    if (fd >= 0) close(fd);
+    return 1;
+  }
+
+  double start = clock_ms();
+
+  struct rlimit limit;
+  int nconns = SERVE_CONNS;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < SERVE_CONNS) nconns = limit.rlim_cur;
+
+  Server server;
+  server.epoll = epoll_create1(EPOLL_CLOEXEC);
+  server.listen = fd;
+  server.conns = calloc(nconns, sizeof(*server.conns));
+  server.nconns = nconns;
+  server.next = 0;
+  server.globals = globals;
+  server.slots = malloc(workers * sizeof(ServeSlot));
+  for (int i = 0; i < workers; i++) {
+    server.slots[i].scratch = arena_new();
+    server.slots[i].cache = cache ? tcache_new(cache) : NULL;
+    server.slots[i].scratch->conv = cache ? ccache_new(cache) : NULL;
+  }
+
+  struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+  epoll_ctl(server.epoll, EPOLL_CTL_ADD, fd, &ev);
+
+  //  workers start with the signals blocked so they reach the loop, and
+  //  without SA_RESTART one wakes it from its wait
+  sigset_t stop, old;
+  sigemptyset(&stop);
+  sigaddset(&stop, SIGINT);
+  sigaddset(&stop, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop, &old);
+  server.pool = pool_new(workers, serve_task, &server);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  struct sigaction act;
+  memset(&act, 0, sizeof(act));
+  act.sa_handler = stop_serving;
+  sigaction(SIGINT, &act, NULL);
+  sigaction(SIGTERM, &act, NULL);
+
+  // library declarations are only decoded once a request names them
+  long decls = globals->decls.len;
+  for (Object* lib = globals->libs; lib; lib = lib->next) decls += lib->header->ndecls;
+  printf("serving '%s' on %d workers, %ld declarations loaded in %.3f ms\n",
+    path, workers, decls, clock_ms() - start);
+  fflush(stdout);
+
+  struct epoll_event events [SERVE_EVENTS];
+  while (serving) {
+    int n = epoll_wait(server.epoll, events, SERVE_EVENTS, -1);
+    if (n < 0 && errno != EINTR) break;
+
+    for (int i = 0; i < n; i++) {
+      int ready = events[i].data.fd;
+      if (ready == fd) serve_accept(&server);
+      else serve_read(&server, atomic_load_explicit(&server.conns[ready], memory_order_acquire));
+    }
+  }
+
+  // requests already handed out are answered before the workers stop
+  pool_delete(server.pool);
+  for (int i = 0; i < nconns; i++) {
+    Conn* conn = atomic_load(&server.conns[i]);
+    if (conn) conn_close(&server, conn);
+  }
+  for (int i = 0; i < workers; i++) {
+    if (server.slots[i].scratch->conv) ccache_delete(server.slots[i].scratch->conv);
+    if (server.slots[i].cache) tcache_delete(server.slots[i].cache);
+    arena_delete(server.slots[i].scratch);
+  }
+
+  close(server.epoll);
+  close(fd);
+  unlink(path);
+  free(server.slots);
+  free(server.conns);
+  printf("stopped serving '%s'\n", path);
+  return 0;
+}
+
+int server_send (const char* path, const char* request) {
+  struct sockaddr_un addr;
+  if (!unix_addr(path, &addr)) return -1;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    printf("cannot reach a server on '%s'\n", path);
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  sink_fd((void*)(intptr_t)fd, request, strlen(request));
+  sink_fd((void*)(intptr_t)fd, "\n", 1);
+
+  //  whole lines are passed on as they come until the status line, the
+  //  bytes of a partial one before 'scan' are known to hold no newline
+  LineBuf in;
+  LineBuf_init(&in, SERVE_READ);
+  int failed = -1;
+  int scan = 0;
+  while (failed < 0) {
+    LineBuf_reserve(&in, in.len + SERVE_READ);
+    ssize_t n = read(fd, in.data + in.len, in.cap - in.len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    in.len += n;
+
+    char* line = in.data;
+    char* end;
+    while (failed < 0 && (end = memchr(in.data + scan, '\n', in.len - scan))) {
+      if (line[0] == '=' && line[1] == ' ') failed = atoi(line + 2);
+      else fwrite(line, 1, end + 1 - line, stdout);
+      line = end + 1;
+      scan = line - in.data;
+    }
+
+    in.len -= line - in.data;
+    memmove(in.data, line, in.len);
+    scan = in.len;
+  }
+
+  if (failed < 0) printf("lost the connection to '%s'\n", path);
+  LineBuf_free(&in);
+  close(fd);
+  return failed;
+}
@@ -0,0 +1,27 @@
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include "globals.h"
+
+// longest request a client may send, it is dropped past this
+#define SERVE_LINE (1 << 20)
+
+//  ____________________________________________________________
+// | request          | response                                |
+// |------------------------------------------------------------|
+// | infer <expr>     | its type                                |
+// | normalize <expr> | its normal form, once it checks         |
+// | check <decls>    | a line per declaration, as with --file  |
+// | file <path>      | the same for a file the server maps     |
+//  ------------------------------------------------------------
+//  requests are lines and a client may send the next before the last
+//  is answered. each response ends with '= <failed>' on a line of its
+//  own, the number of declarations or expressions that failed.
+//  declarations a request makes are seen by that request alone
+int server_run (const char* path, Globals* globals, int workers, size_t cache);
+
+//  sends one request and copies the response to stdout. returns the
+//  failed count it ended with, or -1 when the server was not reached
+int server_send (const char* path, const char* request);
+
+#endif
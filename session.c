@@ -0,0 +1,334 @@
+#include "session.h"
+#include "globals.h"
+#include "validate.h"
+#include "driver.h"
+#include "nbe.h"
+#include "stats.h"
+#include "ccache.h"
+#include <stdio.h>
+#include <string.h>
+
+// an entry holds a handful of small terms, full blocks would be wasted
+#define ENTRY_BLOCK 1024
+
+#define FNV64_OFFSET 0xcbf29ce484222325
+#define FNV64_PRIME  0x100000001b3
+
+//  hashes the types and text of the tokens in [beg, end), so edits to
+//  whitespace between them leave the hash as it was
+static uint64_t range_hash (Tokens* tokens, int beg, int end) {
+  uint64_t hash = FNV64_OFFSET;
+  for (int i = beg; i < end; i++) {
+    hash = (hash ^ tok_type(tokens, i)) * FNV64_PRIME;
+    Span span = tok_span(tokens, i);
+    const char* text = tokens->src + span.off;
+    for (uint32_t c = 0; c < span.len; c++) {
+      hash = (hash ^ (uint8_t)text[c]) * FNV64_PRIME;
+    }
+  }
+  return hash;
+}
+
+//  lays out the type, length and text of each token in [beg, end) into
+//  'key', or only measures them when it is NULL
+static size_t range_key (Tokens* tokens, int beg, int end, char* key) {
+  size_t len = 0;
+  for (int i = beg; i < end; i++) {
+    Span span = tok_span(tokens, i);
+    if (key) {
+      key[len] = tok_type(tokens, i);
+      memcpy(key + len + 1, &span.len, sizeof(uint32_t));
+      memcpy(key + len + 1 + sizeof(uint32_t), tokens->src + span.off, span.len);
+    }
+    len += 1 + sizeof(uint32_t) + span.len;
+  }
+  return len;
+}
+
+static int range_same (Tokens* tokens, int beg, int end, Entry* entry) {
+  size_t len = 0;
+  for (int i = beg; i < end; i++) {
+    Span span = tok_span(tokens, i);
+    if (len + 1 + sizeof(uint32_t) + span.len > entry->key_len) return 0;
+
+    const char* key = entry->key + len;
+    uint32_t key_span;
+    memcpy(&key_span, key + 1, sizeof(uint32_t));
+    if ((uint8_t)key[0] != tok_type(tokens, i) || key_span != span.len) return 0;
+    if (memcmp(key + 1 + sizeof(uint32_t), tokens->src + span.off, span.len) != 0) return 0;
+    len += 1 + sizeof(uint32_t) + span.len;
+  }
+  return len == entry->key_len;
+}
+
+static Entry* entry_new (uint64_t hash, Tokens* tokens, int beg, int end) {
+  Entry* entry = calloc(1, sizeof(Entry));
+  entry->hash = hash;
+  entry->key_len = range_key(tokens, beg, end, NULL);
+  entry->key = malloc(entry->key_len);
+  range_key(tokens, beg, end, entry->key);
+  SymVec_init(&entry->refs, 0);
+  EntryVec_init(&entry->owners, 0);
+  return entry;
+}
+
+static void entry_free (Entry* entry) {
+  if (entry->arena) arena_delete(entry->arena);
+  free(entry->key);
+  SymVec_free(&entry->refs);
+  EntryVec_free(&entry->owners);
+  free(entry);
+}
+
+static void add_ref (Entry* entry, Sym name) {
+  for (int i = 0; i < entry->refs.len; i++) {
+    if (entry->refs.data[i] == name) return;
+  }
+  SymVec_push(&entry->refs, name);
+}
+
+static void collect_refs (Entry* entry, Expr* expr) {
+  ExprStack todo;
+  ExprStack_init(&todo);
+  ExprStack_push(&todo, expr);
+
+  while (todo.len > 0) {
+    expr = ExprStack_pop(&todo);
+    switch (expr->typ) {
+      case EXP_FREE:
+        add_ref(entry, expr->name);
+        // fallthrough
+      case EXP_TERM:
+        if (expr->term.ann) ExprStack_push(&todo, expr->term.ann);
+        break;
+      case EXP_SPINE:
+        for (int i = expr->spine.len; i >= 0; i--) ExprStack_push(&todo, expr->spine.nodes[i]);
+        break;
+      case EXP_LAM:
+      case EXP_PI:
+        ExprStack_push(&todo, expr->lam.rhs);
+        ExprStack_push(&todo, expr->lam.lhs);
+        break;
+      default:
+        break;
+    }
+  }
+
+  ExprStack_free(&todo);
+}
+
+//  parses an entry again from its first token into a fresh arena, so
+//  memory held by its previous terms and results is dropped with it
+static void entry_parse (Entry* entry, Tokens* tokens) {
+  if (entry->arena) arena_delete(entry->arena);
+  entry->arena = arena_sized(ENTRY_BLOCK);
+  SymVec_clear(&entry->refs);
+  entry->type = NULL;
+  entry->why = NULL;
+  entry->error = NULL;
+  entry->val = NULL;
+
+  Parser* parser = parser_new(entry->arena, tokens);
+  parser_seek(parser, entry->tok);
+
+  STAT_START(parsing);
+  int parsed = parse_decl(parser, &entry->decl);
+  STAT_STOP(TIME_PARSE, parsing);
+
+  if (!parsed) {
+    entry->error = arena_alloc(entry->arena, BUF_LEN);
+    parser_error(parser, entry->error, BUF_LEN);
+    entry->why = "parse error";
+  } else {
+    // its own name comes first, its owner is an earlier declaration of it
+    if (entry->decl.name) add_ref(entry, entry->decl.name);
+    if (entry->decl.type) collect_refs(entry, entry->decl.type);
+    if (entry->decl.value) collect_refs(entry, entry->decl.value);
+  }
+
+  parser_delete(parser);
+}
+
+// names resolve to the first declaration of them that parsed
+static Entry* owner_of (Hashmap* first, Sym name) {
+  return hmap_get(first, name, sym_hash_of(name));
+}
+
+//  an entry is out of date when it is new, when one of its names now
+//  resolves elsewhere or when what it resolves to was re-checked
+static int entry_stale (Entry* entry, Hashmap* first) {
+  if (entry->arena == NULL) return 1;
+  for (int i = 0; i < entry->refs.len; i++) {
+    Entry* owner = owner_of(first, entry->refs.data[i]);
+    if (owner != entry->owners.data[i] || (owner && owner->dirty)) return 1;
+  }
+  return 0;
+}
+
+static void entry_check (Entry* entry, Hashmap* first, Globals* globals, Arena* scratch, TypeCache* cache) {
+  EntryVec_clear(&entry->owners);
+  for (int i = 0; i < entry->refs.len; i++) {
+    EntryVec_push(&entry->owners, owner_of(first, entry->refs.data[i]));
+  }
+
+  if (entry->why) return;
+  // a library's name is owned by it for good
+  Sym name = entry->decl.name;
+  if (name && (entry->owners.data[0] || (globals->base && globals_find(globals->base, name)))) {
+    entry->why = "already declared";
+    return;
+  }
+
+  scratch->globals = globals;
+  Expr* type = check_decl(scratch, cache, &entry->decl);
+
+  if (type == NULL) entry->why = "ill-typed";
+  else {
+    entry->type = entry->decl.type ? entry->decl.type : expr_clone(entry->arena, type);
+    if (entry->decl.value) {
+      entry->arena->globals = globals;
+      entry->val = nbe_eval(entry->arena, NULL, entry->decl.value);
+      entry->arena->globals = NULL;
+    }
+  }
+
+  if (cache) tcache_clear(cache);
+  if (scratch->conv) ccache_clear(scratch->conv);
+  arena_reset(scratch);
+  scratch->globals = NULL;
+}
+
+//  the entry of the last version with the same tokens, or a new one.
+//  equal declarations share a hash and are told apart by 'stamp', the
+//  tokens are compared so a colliding hash is never taken for a match
+static Entry* session_match (Session* session, Tokens* tokens, int beg, int end) {
+  uint64_t hash = range_hash(tokens, beg, end);
+  Entry* head = hmap_get(session->by_hash, hash, hash);
+
+  Entry* entry = head;
+  while (entry && (entry->stamp == session->stamp || !range_same(tokens, beg, end, entry))) entry = entry->same;
+
+  if (entry == NULL) {
+    entry = entry_new(hash, tokens, beg, end);
+    entry->same = head;
+    hmap_add(session->by_hash, hash, hash, entry);
+  }
+
+  entry->tok = beg;
+  entry->stamp = session->stamp;
+  return entry;
+}
+
+Session* session_new (Globals* base, size_t cache) {
+  Session* session = malloc(sizeof(Session));
+  EntryVec_init(&session->entries, 0);
+  session->by_hash = hmap_new();
+  session->stamp = 0;
+  session->base = base;
+  session->cache = cache ? tcache_new(cache) : NULL;
+  session->conv = cache ? ccache_new(cache) : NULL;
+  session->total = 0;
+  session->rechecked = 0;
+  session->failed = 0;
+  return session;
+}
+
+void session_delete (Session* session) {
+  for (int i = 0; i < session->entries.len; i++) {
+    entry_free(session->entries.data[i]);
+  }
+  EntryVec_free(&session->entries);
+  hmap_delete(session->by_hash);
+  if (session->cache) tcache_delete(session->cache);
+  if (session->conv) ccache_delete(session->conv);
+  free(session);
+}
+
+//  ______________________________________________________________
+// | lex  | split at 'def' and 'axiom', hash each piece's tokens   |
+// | match| reuse the entry of the last version with equal hash   |
+// | walk | in order, re-check the stale and declare every entry  |
+// | drop | free the entries of the last version left unmatched   |
+//  --------------------------------------------------------------
+int session_update (Session* session, const char* src, size_t len) {
+  double start = clock_ms();
+  session->stamp++;
+  Tokens tokens = tokens_full(src, len);
+
+  EntryVec next;
+  EntryVec_init(&next, session->entries.len + 16);
+
+  int beg = 0;
+  for (int i = 0; i < tok_count(&tokens); i++) {
+    TokenType type = tok_type(&tokens, i);
+    if (i > beg && (is_decl_beg(type) || type == TOK_END_OF_INPUT)) {
+      EntryVec_push(&next, session_match(session, &tokens, beg, i));
+      beg = i;
+    }
+  }
+
+  Hashmap* first = hmap_new();
+  Globals* globals = globals_new();
+  globals->base = session->base;
+  Arena* scratch = arena_new();
+  scratch->conv = session->conv;
+  Printer out;
+  printer_init(&out, sink_file, stdout, print_width);
+  session->total = next.len;
+  session->rechecked = 0;
+  session->failed = 0;
+
+  for (int i = 0; i < next.len; i++) {
+    Entry* entry = next.data[i];
+    entry->dirty = entry_stale(entry, first);
+
+    if (entry->dirty) {
+      double begin = clock_ms();
+      entry_parse(entry, &tokens);
+      entry_check(entry, first, globals, scratch, session->cache);
+
+      if (entry->error) print_fmt(&out, "%s\n", entry->error);
+      report_decl(&out, &entry->decl, entry->type, entry->why, clock_ms() - begin);
+      session->rechecked++;
+    }
+
+    session->failed += entry->type == NULL;
+
+    // a failed check still owns the name, a failed parse does not
+    Sym name = entry->decl.name;
+    if (name && entry->error == NULL && !owner_of(first, name)) {
+      hmap_add(first, name, sym_hash_of(name), entry);
+      Global* global = globals_declare(globals, name, i);
+      if (global) {
+        global->value = entry->decl.value;
+        global->val = entry->val;
+        global->type = entry->type;
+      }
+    }
+  }
+
+  // entries are owned by exactly one version, the old one's leftovers go
+  for (int i = 0; i < session->entries.len; i++) {
+    Entry* entry = session->entries.data[i];
+    if (entry->stamp != session->stamp) entry_free(entry);
+  }
+  EntryVec_free(&session->entries);
+  session->entries = next;
+
+  hmap_clear(session->by_hash);
+  for (int i = 0; i < next.len; i++) {
+    Entry* entry = next.data[i];
+    entry->same = hmap_add(session->by_hash, entry->hash, entry->hash, entry);
+  }
+
+  print_fmt(&out, "%d declarations, %d re-checked, %d failed in %.3f ms\n",
+    session->total, session->rechecked, session->failed, clock_ms() - start);
+  printer_flush(&out);
+  printer_free(&out);
+
+  arena_delete(scratch);
+  globals_delete(globals);
+  hmap_delete(first);
+  tokens_free(&tokens);
+  return session->failed;
+}
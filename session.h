@@ -0,0 +1,68 @@
+#ifndef __SESSION_H__
+#define __SESSION_H__
+
+#include "parser.h"
+#include "hashmap.h"
+#include "tcache.h"
+
+typedef struct Entry Entry;
+typedef struct Value Value;
+typedef struct Globals Globals;
+
+VEC_DEFINE(SymVec, Sym)
+VEC_DEFINE(EntryVec, Entry*)
+
+//  one declaration as of the last update. 'refs' are its own name and
+//  the names it mentions, 'owners' the declarations they resolved to
+//  when it was last checked. its terms, type and value live in 'arena'
+typedef struct Entry {
+  uint64_t hash;
+  // the types and text of its tokens, compared when hashes agree
+  char* key;
+  size_t key_len;
+  Arena* arena;
+  Decl decl;
+  SymVec refs;
+  EntryVec owners;
+
+  Expr* type;
+  const char* why;
+  char* error;
+  Value* val;
+
+  // first token in the latest version and the update that matched it
+  int tok;
+  int stamp;
+  int dirty;
+  // next entry of equal hash
+  Entry* same;
+} Entry;
+
+//  remembers the declarations of a file between versions of it, an
+//  update re-parses and re-checks only those whose tokens changed and
+//  those that, transitively, refer to one that did. names it lacks are
+//  looked up in 'base', which is only read
+typedef struct Session {
+  EntryVec entries;
+  Hashmap* by_hash;
+  int stamp;
+  Globals* base;
+  TypeCache* cache;
+  ConvCache* conv;
+
+  // counts of the last update
+  int total;
+  int rechecked;
+  int failed;
+} Session;
+
+// 'base' may be NULL, 'cache' sizes the caches of checks, zero for none
+Session* session_new (Globals* base, size_t cache);
+void session_delete (Session* session);
+
+//  brings the session up to date with 'src', reporting every declaration
+//  it re-checks. 'src[len]' must be a readable NUL. returns the number
+//  of declarations that fail, re-checked or not
+int session_update (Session* session, const char* src, size_t len);
+
+#endif
@@ -0,0 +1,64 @@
+#include "source.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//  reserves one zeroed page more than the file needs and maps the file
+//  over its start, so the terminator exists even when the file fills
+//  its last page exactly
+int source_map (const char* path, Source* src) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    printf("cannot open '%s'\n", path);
+    return 0;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (uint64_t)st.st_size >= UINT32_MAX) {
+    printf("cannot map '%s'\n", path);
+    close(fd);
+    return 0;
+  }
+
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t len = st.st_size;
+  size_t map = (len / page + 1) * page;
+
+  char* base = mmap(NULL, map, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base != MAP_FAILED && len > 0) {
+    if (mmap(base, len, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+      munmap(base, map);
+      base = MAP_FAILED;
+    }
+  }
+  close(fd);
+
+  if (base == MAP_FAILED) {
+    printf("cannot map '%s'\n", path);
+    return 0;
+  }
+
+  madvise(base, map, MADV_SEQUENTIAL);
+  src->data = base;
+  src->len = len;
+  src->map = map;
+  return 1;
+}
+
+void source_unmap (Source* src) {
+  munmap((void*)src->data, src->map);
+  src->data = NULL;
+  src->len = 0;
+  src->map = 0;
+}
+
+uint64_t source_hash (const char* data, size_t len) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ (uint8_t)data[i]) * 0x100000001b3;
+  }
+  return hash;
+}
@@ -0,0 +1,22 @@
+#ifndef __SOURCE_H__
+#define __SOURCE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//  a read-only view of a source file, mapped rather than read so that
+//  pages are faulted in as the lexer reaches them. the byte past the
+//  end is always a readable NUL
+typedef struct Source {
+  const char* data;
+  size_t len;
+  size_t map;
+} Source;
+
+int source_map (const char* path, Source* src);
+void source_unmap (Source* src);
+
+// 64-bit fnv1a of the contents, to tell whether a file really changed
+uint64_t source_hash (const char* data, size_t len);
+
+#endif
@@ -0,0 +1,103 @@
+#include "stats.h"
+
+#ifdef LAMBDA_STATS
+
+#include <pthread.h>
+#include <time.h>
+#include <string.h>
+
+_Thread_local Stats stats;
+
+static Stats totals;
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* stat_names [STAT_COUNT] = {
+  [STAT_TOKENS] = "tokens",
+  [STAT_EXPR_ALLOC] = "expr_alloc",
+  [STAT_EXPR_EQ] = "expr_eq",
+  [STAT_SUBST_NODES] = "subst_nodes",
+  [STAT_CTX_GET] = "ctx_get",
+  [STAT_SHIFT_NODES] = "shift_nodes",
+  [STAT_HMAP_LOOKUPS] = "hmap_lookups",
+  [STAT_HMAP_PROBES] = "hmap_probes",
+  [STAT_INFER_FREE] = "infer_free",
+  [STAT_INFER_TERM] = "infer_term",
+  [STAT_INFER_KIND] = "infer_kind",
+  [STAT_INFER_SPINE] = "infer_spine",
+  [STAT_INFER_LAM] = "infer_lam",
+  [STAT_INFER_PI] = "infer_pi",
+};
+
+static const char* depth_names [DEPTH_COUNT] = {
+  [DEPTH_EXPR_EQ] = "expr_eq_pending",
+  [DEPTH_INFER] = "infer_depth",
+};
+
+static const char* timer_names [TIME_COUNT] = {
+  [TIME_LEX] = "lex",
+  [TIME_PARSE] = "parse",
+  [TIME_CHECK] = "check",
+  [TIME_CONV] = "conv",
+};
+
+double stats_clock () {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+void stats_flush () {
+  pthread_mutex_lock(&totals_lock);
+  for (int i = 0; i < STAT_COUNT; i++) totals.counts[i] += stats.counts[i];
+  for (int i = 0; i < DEPTH_COUNT; i++) {
+    if (stats.deepest[i] > totals.deepest[i]) totals.deepest[i] = stats.deepest[i];
+  }
+  for (int i = 0; i < TIME_COUNT; i++) totals.ms[i] += stats.ms[i];
+  pthread_mutex_unlock(&totals_lock);
+  memset(&stats, 0, sizeof(Stats));
+}
+
+void stats_report (FILE* out, int json) {
+  stats_flush();
+  const char* sep = "";
+
+  if (json) {
+    fprintf(out, "{\"counters\": {");
+    for (int i = 0; i < STAT_COUNT; i++, sep = ", ") {
+      fprintf(out, "%s\"%s\": %llu", sep, stat_names[i], (unsigned long long)totals.counts[i]);
+    }
+    sep = "";
+    fprintf(out, "}, \"depths\": {");
+    for (int i = 0; i < DEPTH_COUNT; i++, sep = ", ") {
+      fprintf(out, "%s\"%s\": %d", sep, depth_names[i], totals.deepest[i]);
+    }
+    sep = "";
+    fprintf(out, "}, \"ms\": {");
+    for (int i = 0; i < TIME_COUNT; i++, sep = ", ") {
+      fprintf(out, "%s\"%s\": %.3f", sep, timer_names[i], totals.ms[i]);
+    }
+    fprintf(out, "}}\n");
+    return;
+  }
+
+  for (int i = 0; i < STAT_COUNT; i++) {
+    fprintf(out, "%-16s %12llu\n", stat_names[i], (unsigned long long)totals.counts[i]);
+  }
+  for (int i = 0; i < DEPTH_COUNT; i++) {
+    fprintf(out, "%-16s %12d\n", depth_names[i], totals.deepest[i]);
+  }
+  for (int i = 0; i < TIME_COUNT; i++) {
+    fprintf(out, "%-16s %12.3f ms\n", timer_names[i], totals.ms[i]);
+  }
+}
+
+#else
+
+void stats_flush () {}
+
+void stats_report (FILE* out, int json) {
+  if (json) fprintf(out, "{}\n");
+  else fprintf(out, "stats are compiled out, build with -DLAMBDA_STATS\n");
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+//  hot-path counters, built in only with -DLAMBDA_STATS. otherwise every
+//  STAT_ macro expands to nothing and no counter exists
+typedef enum StatId {
+  STAT_TOKENS,
+  STAT_EXPR_ALLOC,
+  STAT_EXPR_EQ,
+  STAT_SUBST_NODES,
+  STAT_CTX_GET,
+  STAT_SHIFT_NODES,
+  STAT_HMAP_LOOKUPS,
+  STAT_HMAP_PROBES,
+  // one per ExprType, in the same order
+  STAT_INFER_FREE,
+  STAT_INFER_TERM,
+  STAT_INFER_KIND,
+  STAT_INFER_SPINE,
+  STAT_INFER_LAM,
+  STAT_INFER_PI,
+  STAT_COUNT,
+} StatId;
+
+// recursion depths and explicit stack lengths, only the deepest is kept
+typedef enum DepthId {
+  DEPTH_EXPR_EQ,
+  DEPTH_INFER,
+  DEPTH_COUNT,
+} DepthId;
+
+//  wall-clock timers, an inner phase is also counted in the outer one.
+//  a streamed file is lexed a token at a time, so its lex time carries
+//  the cost of the clock reads as well
+typedef enum TimerId {
+  TIME_LEX,
+  TIME_PARSE,
+  TIME_CHECK,
+  TIME_CONV,
+  TIME_COUNT,
+} TimerId;
+
+#ifdef LAMBDA_STATS
+
+//  each thread counts into its own copy, which is added to the totals
+//  when the thread is done with it
+typedef struct Stats {
+  uint64_t counts [STAT_COUNT];
+  int depth [DEPTH_COUNT];
+  int deepest [DEPTH_COUNT];
+  double ms [TIME_COUNT];
+} Stats;
+
+extern _Thread_local Stats stats;
+
+double stats_clock ();
+
+#define STAT_INC(ID)    (stats.counts[ID]++)
+#define STAT_ADD(ID, N) (stats.counts[ID] += (N))
+#define STAT_ENTER(ID)  do { if (++stats.depth[ID] > stats.deepest[ID]) stats.deepest[ID] = stats.depth[ID]; } while (0)
+#define STAT_LEAVE(ID)  (stats.depth[ID]--)
+#define STAT_MAX(ID, N) do { if ((N) > stats.deepest[ID]) stats.deepest[ID] = (N); } while (0)
+#define STAT_START(T)   double T = stats_clock()
+#define STAT_STOP(ID, T) (stats.ms[ID] += stats_clock() - (T))
+#define STAT_FLUSH()    stats_flush()
+
+#else
+
+#define STAT_INC(ID)
+#define STAT_ADD(ID, N)
+#define STAT_ENTER(ID)
+#define STAT_LEAVE(ID)
+#define STAT_MAX(ID, N)
+#define STAT_START(T)
+#define STAT_STOP(ID, T)
+#define STAT_FLUSH()
+
+#endif
+
+// adds the calling thread's counters to the totals and zeroes them
+void stats_flush ();
+void stats_report (FILE* out, int json);
+
+#endif
@@ -0,0 +1,123 @@
+#include "symtab.h"
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define SYMTAB_INIT 1024
+// segment i holds SYMTAB_INIT << i entries, enough for every Sym
+#define SYMTAB_SEGS 23
+
+typedef struct SymEntry {
+  const char* name;
+  uint32_t len;
+  uint32_t hash;
+} SymEntry;
+
+//  slots hold 'Sym + 1' so that zero marks an empty slot. entries live
+//  in segments that double in size and are never moved, so names are
+//  read without the lock that interning takes
+typedef struct Symtab {
+  pthread_mutex_t lock;
+  Arena* names;
+  SymEntry* segs [SYMTAB_SEGS];
+  int nsegs;
+  uint32_t* slots;
+  uint32_t len;
+  uint32_t cap;
+  uint32_t mask;
+} Symtab;
+
+static Symtab table = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static inline SymEntry* sym_entry (Sym sym) {
+  int seg = 31 - __builtin_clz(sym / SYMTAB_INIT + 1);
+  return &table.segs[seg][sym - SYMTAB_INIT * ((1u << seg) - 1)];
+}
+
+uint32_t sym_hash (const char* str, int len) {
+  uint32_t hash = SYM_HASH_INIT;
+  for (int i = 0; i < len; i++) {
+    hash = SYM_HASH_STEP(hash, str[i]);
+  }
+  return hash;
+}
+
+// adds a segment and rehashes into slots at most half full
+static void symtab_grow () {
+  uint32_t size = SYMTAB_INIT << table.nsegs;
+  table.segs[table.nsegs++] = malloc(size * sizeof(SymEntry));
+  table.cap += size;
+  table.mask = (SYMTAB_INIT << (table.nsegs + 1)) - 1;
+
+  free(table.slots);
+  table.slots = calloc(table.mask + 1, sizeof(uint32_t));
+
+  for (uint32_t i = 0; i < table.len; i++) {
+    uint32_t slot = sym_entry(i)->hash & table.mask;
+    while (table.slots[slot]) slot = (slot + 1) & table.mask;
+    table.slots[slot] = i + 1;
+  }
+}
+
+static Sym symtab_intern (const char* str, int len, uint32_t hash) {
+  uint32_t slot = hash & table.mask;
+  while (table.slots[slot]) {
+    SymEntry* e = sym_entry(table.slots[slot] - 1);
+    if (e->hash == hash && e->len == (uint32_t)len && memcmp(e->name, str, len) == 0) {
+      return table.slots[slot] - 1;
+    }
+    slot = (slot + 1) & table.mask;
+  }
+
+  if (table.len == table.cap) {
+    symtab_grow();
+    return symtab_intern(str, len, hash);
+  }
+
+  char* name = arena_alloc(table.names, len + 1);
+  memcpy(name, str, len);
+  name[len] = '\0';
+
+  Sym sym = table.len++;
+  SymEntry* entry = sym_entry(sym);
+  entry->name = name;
+  entry->len = len;
+  entry->hash = hash;
+  table.slots[slot] = sym + 1;
+  return sym;
+}
+
+Sym sym_intern (const char* str, int len, uint32_t hash) {
+  pthread_mutex_lock(&table.lock);
+  if (!table.names) {
+    table.names = arena_new();
+    symtab_grow();
+    // reserve SYM_NONE for the empty name
+    symtab_intern("", 0, sym_hash("", 0));
+  }
+  Sym sym = symtab_intern(str, len, hash);
+  pthread_mutex_unlock(&table.lock);
+  return sym;
+}
+
+Sym sym_from (const char* str) {
+  int len = strlen(str);
+  return sym_intern(str, len, sym_hash(str, len));
+}
+
+const char* sym_name (Sym sym) {
+  return sym_entry(sym)->name;
+}
+
+int sym_len (Sym sym) {
+  return sym_entry(sym)->len;
+}
+
+uint32_t sym_hash_of (Sym sym) {
+  return sym_entry(sym)->hash;
+}
+
+int sym_count () {
+  return table.len;
+}
@@ -0,0 +1,26 @@
+#ifndef __SYMTAB_H__
+#define __SYMTAB_H__
+
+#include <stdint.h>
+
+// interned identifier, index into the global symbol table
+typedef uint32_t Sym;
+
+#define SYM_NONE 0
+
+// 32-bit fnv1a, exposed so the lexer can hash while it scans
+#define SYM_HASH_INIT 0x811c9dc5
+#define SYM_HASH_STEP(H, C) (((H) ^ (unsigned char)(C)) * 0x01000193)
+
+uint32_t sym_hash (const char* str, int len);
+
+// may be called from any thread, looking a Sym up never blocks
+Sym sym_intern (const char* str, int len, uint32_t hash);
+Sym sym_from   (const char* str);
+
+const char* sym_name (Sym sym);
+int sym_len   (Sym sym);
+uint32_t sym_hash_of (Sym sym);
+int sym_count ();
+
+#endif
@@ -0,0 +1,82 @@
+#include "tcache.h"
+#include <stdlib.h>
+#include <string.h>
+
+TypeCache* tcache_new (size_t cap) {
+  size_t buckets = 1;
+  while (buckets * TCACHE_WAYS < cap) buckets *= 2;
+
+  TypeCache* cache = (TypeCache*)malloc(sizeof(TypeCache));
+  cache->cap = buckets * TCACHE_WAYS;
+  cache->entries = calloc(cache->cap, sizeof(TCacheEntry));
+  cache->clock = 0;
+  cache->hits = 0;
+  cache->misses = 0;
+  cache->evictions = 0;
+  return cache;
+}
+
+void tcache_delete (TypeCache* cache) {
+  free(cache->entries);
+  free(cache);
+}
+
+void tcache_clear (TypeCache* cache) {
+  memset(cache->entries, 0, cache->cap * sizeof(TCacheEntry));
+}
+
+TCacheEntry* tcache_bucket (TypeCache* cache, Expr* expr) {
+  uint64_t x = (uintptr_t)expr;
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  size_t buckets = cache->cap / TCACHE_WAYS;
+  return &cache->entries[(x & (buckets - 1)) * TCACHE_WAYS];
+}
+
+//  entries of the same expression share its bound, so the fingerprint
+//  of the current context is computed at most once per lookup
+Expr* tcache_get (TypeCache* cache, Expr* expr, fp_fn fp, void* data) {
+  TCacheEntry* bucket = tcache_bucket(cache, expr);
+  int known = 0;
+  uint64_t cur = 0;
+
+  for (int i = 0; i < TCACHE_WAYS; i++) {
+    TCacheEntry* e = &bucket[i];
+    if (e->expr != expr) continue;
+
+    if (!known) {
+      cur = fp(data, e->bound);
+      known = 1;
+    }
+
+    if (e->fp == cur) {
+      e->stamp = ++cache->clock;
+      cache->hits++;
+      return e->type;
+    }
+  }
+
+  cache->misses++;
+  return NULL;
+}
+
+void tcache_put (TypeCache* cache, Expr* expr, int bound, uint64_t fp, Expr* type) {
+  TCacheEntry* bucket = tcache_bucket(cache, expr);
+  TCacheEntry* victim = &bucket[0];
+
+  for (int i = 0; i < TCACHE_WAYS; i++) {
+    if (!bucket[i].expr) {
+      victim = &bucket[i];
+      break;
+    }
+    if (bucket[i].stamp < victim->stamp) victim = &bucket[i];
+  }
+
+  if (victim->expr) cache->evictions++;
+  victim->expr = expr;
+  victim->type = type;
+  victim->fp = fp;
+  victim->bound = bound;
+  victim->stamp = ++cache->clock;
+}
@@ -0,0 +1,41 @@
+#ifndef __TCACHE_H__
+#define __TCACHE_H__
+
+#include "parser.h"
+
+// ways per bucket, the least recently used entry of a full bucket is evicted
+#define TCACHE_WAYS 4
+
+//  'bound' is one past the largest free index of 'expr', only the
+//  types of that many innermost binders can influence its type and
+//  'fp' is the fingerprint of exactly those
+typedef struct TCacheEntry {
+  Expr* expr;
+  Expr* type;
+  uint64_t fp;
+  uint64_t stamp;
+  int bound;
+} TCacheEntry;
+
+typedef uint64_t (*fp_fn) (void* data, int bound);
+
+//  memoizes inferred types, entries point into the arena the types
+//  were built in, clear the cache whenever that arena is reset unless
+//  it interns into a HashCons, whose nodes outlive any reset
+typedef struct TypeCache {
+  TCacheEntry* entries;
+  size_t cap;
+  uint64_t clock;
+  size_t hits;
+  size_t misses;
+  size_t evictions;
+} TypeCache;
+
+TypeCache* tcache_new (size_t cap);
+void tcache_delete (TypeCache* cache);
+void tcache_clear  (TypeCache* cache);
+
+Expr* tcache_get (TypeCache* cache, Expr* expr, fp_fn fp, void* data);
+void tcache_put  (TypeCache* cache, Expr* expr, int bound, uint64_t fp, Expr* type);
+
+#endif
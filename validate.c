@@ -3,174 +3,626 @@
 #include "hashmap.h"
 #include "parser.h"
 #include "strop.h"
+#include "nbe.h"
+#include "tcache.h"
+#include "globals.h"
+#include "stats.h"
+#include "deep.h"
+#include "printer.h"
 
-Expr term (const char* str) {
-  VEC(Token) toks = tokenize(str);
+Expr term (Arena* arena, const char* str) {
+  Tokens toks = tokenize(str);
   Expr res;
-  parse(toks, &res);
-  VEC_FREE(toks);
+  parse(arena, &toks, &res);
+  tokens_free(&toks);
   return res;
 }
 
+int ann_eq (Expr* lhs, Expr* rhs) {
+  if (!lhs || !rhs) return lhs == rhs;
+  return expr_eq(lhs, rhs);
+}
+
+typedef struct ExprPair {
+  Expr* lhs;
+  Expr* rhs;
+} ExprPair;
+
+SVEC_DEFINE(PairStack, ExprPair, 32)
+
+//  pairs still to compare are kept on an explicit stack, so the depth of
+//  the terms costs heap rather than native stack. children are pushed
+//  right to left and compared in the order the recursion would have
 int expr_eq (Expr *lhs, Expr *rhs) {
-  if (lhs->typ != rhs->typ) return 0;
-
-  switch (lhs->typ) {
-    case EXP_KIND: return 1;
-    case EXP_TERM: return lhs->term.idx == rhs->term.idx;
-    case EXP_FREE: return strcmp(lhs->free, rhs->free) == 0;
-    case EXP_APP: return expr_eq(lhs->app.lhs, rhs->app.lhs) && expr_eq(lhs->app.rhs, rhs->app.rhs);
-    case EXP_LAM: return expr_eq(lhs->lam.lhs->annot.ann, rhs->lam.lhs->annot.ann) && expr_eq(lhs->lam.rhs, rhs->lam.rhs); 
-    case EXP_PI: {
-      if (lhs->pi.dep != rhs->pi.dep) return 0;
-      if (!lhs->pi.dep) return expr_eq(lhs->pi.lhs, rhs->pi.lhs) && expr_eq(rhs->pi.rhs, rhs->pi.rhs);
-      return expr_eq(lhs->pi.lhs->annot.ann, rhs->pi.lhs->annot.ann) && expr_eq(rhs->pi.rhs, rhs->pi.rhs);
+  PairStack todo;
+  PairStack_init(&todo);
+  PairStack_push(&todo, (ExprPair){ lhs, rhs });
+
+  int eq = 1;
+  while (eq && todo.len > 0) {
+    STAT_MAX(DEPTH_EXPR_EQ, todo.len);
+    ExprPair pair = PairStack_pop(&todo);
+    Expr* l = pair.lhs;
+    Expr* r = pair.rhs;
+
+    STAT_INC(STAT_EXPR_EQ);
+    if (l == r) continue;
+    // only annotations may be missing, and then on both sides
+    if (!l || !r) { eq = 0; break; }
+    // equal terms agree on their metadata, most unequal ones do not
+    if (l->hash != r->hash || l->size != r->size) { eq = 0; break; }
+    // interned nodes are unique, so distinct addresses are distinct terms
+    if (l->flags & r->flags & EXPR_SHARED) { eq = 0; break; }
+    if (l->typ != r->typ) { eq = 0; break; }
+
+    switch (l->typ) {
+      case EXP_KIND: break;
+      case EXP_TERM:
+      case EXP_FREE:
+        eq = l->typ == EXP_TERM ? l->term.idx == r->term.idx : l->name == r->name;
+        PairStack_push(&todo, (ExprPair){ l->term.ann, r->term.ann });
+        break;
+      case EXP_PI:
+        eq = l->dep == r->dep;
+        // fallthrough
+      case EXP_LAM:
+        PairStack_push(&todo, (ExprPair){ l->lam.rhs, r->lam.rhs });
+        PairStack_push(&todo, (ExprPair){ l->lam.lhs->term.ann, r->lam.lhs->term.ann });
+        break;
+      case EXP_SPINE:
+        eq = l->spine.len == r->spine.len;
+        for (int i = l->spine.len; eq && i >= 0; i--) {
+          PairStack_push(&todo, (ExprPair){ l->spine.nodes[i], r->spine.nodes[i] });
+        }
+        break;
     }
   }
+
+  PairStack_free(&todo);
+  return eq;
 }
 
-typedef struct Pair {
-  Expr* expr;
+// odd multiplier of the context fingerprint and its inverse modulo 2^64
+#define FP_MUL 0x9e3779b97f4a7c15ULL
+#define FP_INV 0xf1de83e19937733dULL
+
+//  prefix sums of binder type hashes h(m) * FP_INV^m over levels m < l,
+//  from which the fingerprint of any run of innermost binders follows
+typedef struct Fingerprint {
+  uint64_t sum;
+  uint64_t mul;
+  uint64_t inv;
+} Fingerprint;
+
+//  a binder's annotation, which lives in the scope outside of it, and
+//  the annotation as last shifted to the depth 'at', -1 until then
+typedef struct Binder {
   Expr* type;
-} Pair;
+  Expr* shifted;
+  int at;
+} Binder;
+
+//  one entry per binder in scope, indexed by de Bruijn level: 'types' 
+//  holds the binder's annotation and 'env' a rigid value standing for
+//  it during evaluation, innermost first. 'fps' has one extra entry 
+//  for the empty prefix
+SVEC_DEFINE(FpStack, Fingerprint, 33)
+SVEC_DEFINE(BinderStack, Binder, 32)
 
 typedef struct Context {
-  VEC(Pair) pairs; 
+  Arena* arena;
+  TypeCache* cache;
+  BinderStack types;
+  FpStack fps;
+  Env* env;
+  int depth;
+  Blame* blame;
 } Context;
 
-Expr* ctx_push (Context* ctx, Expr* expr, Expr* type) {
-  Pair pair;
-  pair.expr = expr;
-  pair.type = type;
+uint64_t fp_hash (Expr* type) {
+  uint64_t x = (uintptr_t)type;
+  x ^= x >> 31;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 29;
+  return x;
+}
 
-  VEC_PUSH(ctx->pairs, pair); 
-  return type;
+//  hashes the types of the 'bound' innermost binders, weighted by their 
+//  de Bruijn index so the result does not depend on the depth they sit at
+uint64_t ctx_fingerprint (void* data, int bound) {
+  Context* ctx = data;
+  Fingerprint* top = &ctx->fps.data[ctx->depth];
+  Fingerprint* low = &ctx->fps.data[ctx->depth - bound];
+  uint64_t scale = ctx->depth > 0 ? ctx->fps.data[ctx->depth - 1].mul : 1;
+  return (scale * (top->sum - low->sum)) ^ (uint64_t)bound;
 }
 
-void ctx_rem (Context* ctx, Expr* expr) {
-  for (int i = VEC_LEN(ctx->pairs)-1; i >= 0; i++) {
-    if (expr_eq(ctx->pairs[i].expr, expr)) {
-      VEC_REM(ctx->pairs, i);
-    }
-  }
+void ctx_bind (Context* ctx, Expr* bind) {
+  BinderStack_push(&ctx->types, (Binder){ bind->term.ann, NULL, -1 });
+
+  Fingerprint last = ctx->fps.data[ctx->depth];
+  Fingerprint next;
+  next.sum = last.sum + fp_hash(bind->term.ann) * last.inv;
+  next.mul = last.mul * FP_MUL;
+  next.inv = last.inv * FP_INV;
+  FpStack_push(&ctx->fps, next);
+
+  ctx->env = env_push(ctx->arena, ctx->env, nbe_var(ctx->arena, ctx->depth, bind->name));
+  ctx->depth++;
+}
+
+void ctx_unbind (Context* ctx) {
+  BinderStack_pop(&ctx->types);
+  FpStack_pop(&ctx->fps);
+  ctx->env = ctx->env->next;
+  ctx->depth--;
 }
 
+//  a binder's type lives in the scope outside of it and is shifted
+//  over every binder pushed since, itself included. the binders below
+//  stay the same while it is in scope, so a shift is done once per
+//  depth it is looked up at rather than once per lookup
 Expr* ctx_get (Context* ctx, Expr* expr) {
-  if (expr->typ == EXP_KIND) return expr;
-  for (int i = VEC_LEN(ctx->pairs)-1; i >= 0; i--) {
-    if (expr_eq(ctx->pairs[i].expr, expr)) {
-      return ctx->pairs[i].type;
+  STAT_INC(STAT_CTX_GET);
+  switch (expr->typ) {
+    case EXP_KIND: 
+      return expr;
+    case EXP_TERM: {
+      int idx = expr->term.idx;
+      if (idx >= ctx->depth) return NULL;
+      Binder* bind = &ctx->types.data[ctx->depth - 1 - idx];
+      if (bind->at != ctx->depth) {
+        bind->shifted = shift(ctx->arena, bind->type, idx + 1, 0);
+        bind->at = ctx->depth;
+      }
+      return bind->shifted;
+    }
+    case EXP_FREE: {
+      // declared types are closed and need no shifting
+      Global* global = ctx->arena->globals ? globals_get(ctx->arena->globals, expr->name) : NULL;
+      return global ? global->type : NULL;
     }
+    default: 
+      return NULL;
   }
-  return NULL;
 }
 
-Expr* pi_new (Expr* lhs, Expr* rhs) {
-  Expr* pi = malloc(sizeof(Expr));
-  pi->typ = EXP_PI;
-  pi->pi.lhs = lhs;
-  pi->pi.rhs = rhs;
-  pi->pi.dep = is_subterm(rhs, lhs);
-  return pi;
+Expr* pi_new (Arena* arena, Expr* lhs, Expr* rhs) {
+  Expr pi;
+  memset(&pi, 0, sizeof(Expr));
+  pi.typ = EXP_PI;
+  pi.name = lhs->name;
+  pi.pi.lhs = lhs;
+  pi.pi.rhs = rhs;
+  pi.dep = occurs(rhs, 0);
+  return expr_alloc(arena, &pi);
+}
+
+Expr* with_ann (Arena* arena, Expr* expr, Expr* ann) {
+  if (ann == expr->term.ann) return expr;
+  STAT_INC(STAT_SUBST_NODES);
+  Expr var = *expr;
+  var.term.ann = ann;
+  return expr_alloc(arena, &var);
+}
+
+//  shifting and substituting leave a binder's own variable as it is,
+//  so a PI keeps its 'dep' without looking for it again
+Expr* with_children (Arena* arena, Expr* expr, Expr* lhs, Expr* rhs) {
+  if (lhs == expr->lam.lhs && rhs == expr->lam.rhs) return expr;
+  STAT_INC(STAT_SUBST_NODES);
+  Expr node = *expr;
+  node.lam.lhs = lhs;
+  node.lam.rhs = rhs;
+  return expr_alloc(arena, &node);
+}
+
+//  the nodes of a spine being rebuilt, copied the first time one of
+//  them changes. 'nodes' is the spine's own array until then
+static Expr** with_node (Arena* arena, Expr* expr, Expr** nodes, int i, Expr* node) {
+  if (nodes == expr->spine.nodes) {
+    if (node == nodes[i]) return nodes;
+    nodes = arena_alloc(arena, (expr->spine.len + 1) * sizeof(Expr*));
+    memcpy(nodes, expr->spine.nodes, (expr->spine.len + 1) * sizeof(Expr*));
+  }
+  nodes[i] = node;
+  return nodes;
+}
+
+// a head that became a spine has its arguments moved into this one
+static Expr* with_nodes (Arena* arena, Expr* expr, Expr** nodes) {
+  if (nodes == expr->spine.nodes) return expr;
+  STAT_INC(STAT_SUBST_NODES);
+  if (nodes[0]->typ == EXP_SPINE) return spine_new(arena, nodes[0], nodes + 1, expr->spine.len);
+  Expr node = *expr;
+  node.spine.nodes = nodes;
+  return expr_alloc(arena, &node);
+}
+
+//  the traversals below only copy the path down to a changed variable,
+//  untouched subtrees are returned as they are. the binder of a LAM or PI
+//  is not a variable occurrence, only its annotation is visited. when the
+//  stack runs low they carry on on a heap segment, see deep.h
+
+typedef struct Rebuild {
+  Arena* arena;
+  Expr* expr;
+  int idx;
+  int by;
+  Expr** subs;
+  Expr* res;
+} Rebuild;
+
+static void shift_deep (void* data) {
+  Rebuild* call = data;
+  call->res = shift(call->arena, call->expr, call->by, call->idx);
 }
 
-Expr* subst (Expr* expr, Expr* term, Expr* sub) {
+static void subst_deep (void* data) {
+  Rebuild* call = data;
+  call->res = subst_many(call->arena, call->expr, call->idx, call->subs, call->by);
+}
+
+//  the nodes it looks at are counted, which is also what a lookup
+//  in the context costs
+Expr* shift (Arena* arena, Expr* expr, int by, int cutoff) {
+  if (deep_low()) {
+    Rebuild call = { arena, expr, cutoff, by, NULL, NULL };
+    deep_run(shift_deep, &call);
+    return call.res;
+  }
+  STAT_INC(STAT_SHIFT_NODES);
+  // nothing at or past the cutoff is free in it
+  if (expr->bound <= cutoff) return expr;
+
   switch (expr->typ) {
     case EXP_KIND: return expr;
-    case EXP_TERM:
-    case EXP_FREE: {
-        if (expr->annot.typ == ANN_TYPED) expr->annot.ann = subst(expr->annot.ann, term, sub);
-        if (expr_eq(expr, term)) return sub; 
-        else return expr;
-    }
-    case EXP_APP: {
-      Expr* lhs = subst(expr->app.lhs, term, sub);
-      Expr* rhs = subst(expr->app.rhs, term, sub);
-      Expr* app = malloc(sizeof(Expr));
-      app->typ = EXP_APP;
-      app->app.lhs = lhs;
-      app->app.rhs = rhs;
-      return app;
+    case EXP_FREE: 
+      return expr->term.ann ? with_ann(arena, expr, shift(arena, expr->term.ann, by, cutoff)) : expr;
+    case EXP_TERM: {
+      Expr* ann = expr->term.ann ? shift(arena, expr->term.ann, by, cutoff) : NULL;
+      if (expr->term.idx < cutoff) return with_ann(arena, expr, ann);
+
+      STAT_INC(STAT_SUBST_NODES);
+      Expr var = *expr;
+      var.term.idx += by;
+      var.term.ann = ann;
+      return expr_alloc(arena, &var);
     }
-    case EXP_LAM: {
-      Expr* lam = malloc(sizeof(Expr));
-      lam->typ = EXP_LAM;
-      lam->lam.lhs = subst(expr->pi.lhs, term, sub);
-      lam->lam.rhs = subst(expr->pi.rhs, term, sub);
-      return lam;
+    case EXP_SPINE: {
+      Expr** nodes = expr->spine.nodes;
+      for (int i = 0; i <= expr->spine.len; i++) {
+        nodes = with_node(arena, expr, nodes, i, shift(arena, expr->spine.nodes[i], by, cutoff));
+      }
+      return with_nodes(arena, expr, nodes);
     }
-    case EXP_PI: {   
-      Expr* lhs = subst(expr->pi.lhs, term, sub);
-      Expr* rhs = subst(expr->pi.rhs, term, sub);
-      Expr* pi = pi_new(lhs, rhs);
-      return pi;
+    case EXP_LAM:
+    case EXP_PI: {
+      Expr* bind = expr->lam.lhs;
+      bind = with_ann(arena, bind, shift(arena, bind->term.ann, by, cutoff));
+      return with_children(arena, expr, bind, shift(arena, expr->lam.rhs, by, cutoff + 1));
     }
   }
+  return expr;
 }
 
-int is_subterm (Expr* expr, Expr* term) {
-  if (expr->annot.typ == ANN_TYPED && is_subterm(expr->annot.ann, term)) return 1;
+//  replaces the 'n' variables from 'idx' on with 'subs' at once, the
+//  last of 'subs' for 'idx' itself, and closes the gap they leave.
+//  'subs' live outside of the binders crossed so far and are shifted over them
+Expr* subst_many (Arena* arena, Expr* expr, int idx, Expr** subs, int n) {
+  if (expr->bound <= idx) return expr;
+  if (deep_low()) {
+    Rebuild call = { arena, expr, idx, n, subs, NULL };
+    deep_run(subst_deep, &call);
+    return call.res;
+  }
+
   switch (expr->typ) {
-    case EXP_KIND: return 0;
-    case EXP_TERM: 
-    case EXP_FREE: return expr_eq(expr, term);
-    case EXP_APP: return is_subterm(expr->app.lhs, term) || is_subterm(expr->app.rhs, term);
-    case EXP_LAM: return is_subterm(expr->lam.lhs, term) || is_subterm(expr->lam.rhs, term);
-    case EXP_PI: return is_subterm(expr->pi.lhs, term) || is_subterm(expr->pi.rhs, term);
+    case EXP_KIND: return expr;
+    case EXP_FREE: 
+      return expr->term.ann ? with_ann(arena, expr, subst_many(arena, expr->term.ann, idx, subs, n)) : expr;
+    case EXP_TERM: {
+      int var = expr->term.idx - idx;
+      if (var >= 0 && var < n) return shift(arena, subs[n - 1 - var], idx, 0);
+      Expr* ann = expr->term.ann ? subst_many(arena, expr->term.ann, idx, subs, n) : NULL;
+      if (var < 0) return with_ann(arena, expr, ann);
+
+      STAT_INC(STAT_SUBST_NODES);
+      Expr node = *expr;
+      node.term.idx -= n;
+      node.term.ann = ann;
+      return expr_alloc(arena, &node);
+    }
+    case EXP_SPINE: {
+      Expr** nodes = expr->spine.nodes;
+      for (int i = 0; i <= expr->spine.len; i++) {
+        nodes = with_node(arena, expr, nodes, i, subst_many(arena, expr->spine.nodes[i], idx, subs, n));
+      }
+      return with_nodes(arena, expr, nodes);
+    }
+    case EXP_LAM:
+    case EXP_PI: {
+      Expr* bind = expr->lam.lhs;
+      bind = with_ann(arena, bind, subst_many(arena, bind->term.ann, idx, subs, n));
+      return with_children(arena, expr, bind, subst_many(arena, expr->lam.rhs, idx + 1, subs, n));
+    }
+  }
+  return expr;
+}
+
+Expr* subst (Arena* arena, Expr* expr, int idx, Expr* sub) {
+  return subst_many(arena, expr, idx, &sub, 1);
+}
+
+Expr* instantiate (Arena* arena, Expr* body, Expr* arg) {
+  return subst(arena, body, 0, arg);
+}
+
+// 'body' sits under 'n' binders, the first of 'args' is for the outermost
+Expr* instantiate_many (Arena* arena, Expr* body, Expr** args, int n) {
+  return n > 0 ? subst_many(arena, body, 0, args, n) : body;
+}
+
+typedef struct Occurrence {
+  Expr* expr;
+  int idx;
+} Occurrence;
+
+SVEC_DEFINE(OccurStack, Occurrence, 32)
+
+//  read off 'fv' when it is exact, else the walk skips every subtree
+//  that certainly lacks the index it looks for. the largest free index
+//  is always known, so it never needs the walk
+int occurs (Expr* expr, int idx) {
+  if (!expr_has_free(expr, idx)) return 0;
+  if (expr_fv_exact(expr) || idx == expr->bound - 1) return 1;
+
+  OccurStack todo;
+  OccurStack_init(&todo);
+  OccurStack_push(&todo, (Occurrence){ expr, idx });
+
+  int found = 0;
+  while (!found && todo.len > 0) {
+    Occurrence top = OccurStack_pop(&todo);
+    Expr* expr = top.expr;
+    if (!expr_has_free(expr, top.idx)) continue;
+
+    switch (expr->typ) {
+      case EXP_KIND: break;
+      case EXP_TERM:
+      case EXP_FREE:
+        found = expr->typ == EXP_TERM && expr->term.idx == top.idx;
+        if (expr->term.ann) OccurStack_push(&todo, (Occurrence){ expr->term.ann, top.idx });
+        break;
+      case EXP_SPINE:
+        for (int i = expr->spine.len; i >= 0; i--) {
+          OccurStack_push(&todo, (Occurrence){ expr->spine.nodes[i], top.idx });
+        }
+        break;
+      case EXP_LAM:
+      case EXP_PI:
+        OccurStack_push(&todo, (Occurrence){ expr->lam.rhs, top.idx + 1 });
+        OccurStack_push(&todo, (Occurrence){ expr->lam.lhs->term.ann, top.idx });
+        break;
+    }
+  }
+
+  OccurStack_free(&todo);
+  return found;
+}
+
+void ctx_init (Context* ctx, Arena* arena, TypeCache* cache) {
+  Fingerprint empty = { 0, 1, 1 };
+  ctx->arena = arena;
+  ctx->cache = cache;
+  BinderStack_init(&ctx->types);
+  FpStack_init(&ctx->fps);
+  ctx->env = NULL;
+  ctx->depth = 0;
+  ctx->blame = NULL;
+  FpStack_push(&ctx->fps, empty);
+}
+
+// notes the first failure only, the ones after it are its consequences
+static Expr* fail (Context* ctx, Expr* expr, const char* why) {
+  if (ctx->blame && ctx->blame->expr == NULL) {
+    ctx->blame->expr = expr;
+    ctx->blame->why = why;
   }
+  return NULL;
+}
+
+void ctx_free (Context* ctx) {
+  BinderStack_free(&ctx->types);
+  FpStack_free(&ctx->fps);
 }
 
-Expr* check (Expr* expr) {
+Expr* check_with (Arena* arena, TypeCache* cache, Expr* expr) {
+  STAT_START(start);
   Context ctx;
-  ctx.pairs = VEC_NEW(Pair, 2);
-  return type_check(&ctx, expr);
+  ctx_init(&ctx, arena, cache);
+  Expr* type = type_check(&ctx, expr);
+  ctx_free(&ctx);
+  STAT_STOP(TIME_CHECK, start);
+  return type;
+}
+
+Expr* check (Arena* arena, Expr* expr) {
+  return check_with(arena, NULL, expr);
 }
 
 void print_ctx (Context* ctx) {
-  if (VEC_LEN(ctx->pairs) == 0) return;
-  printf("---len: %d---\n", VEC_LEN(ctx->pairs));
-  for (int i = 0; i < VEC_LEN(ctx->pairs); i++) {
-    print_expr(ctx->pairs[i].expr);
-    printf(": ");
-    print_expr(ctx->pairs[i].type);
-    printf("\n");
+  if (ctx->depth == 0) return;
+  Printer p;
+  printer_init(&p, sink_file, stdout, print_width);
+  print_fmt(&p, "---len: %d---\n", ctx->depth);
+  for (int i = 0; i < ctx->depth; i++) {
+    print_fmt(&p, "#%d: ", i);
+    print_term(&p, ctx->types.data[i].type);
+    print_str(&p, "\n");
   }
-  printf("------------\n");
+  print_str(&p, "------------\n");
+  printer_flush(&p);
+  printer_free(&p);
 }
 
-Expr* type_check (Context *ctx, Expr *expr) {
+// with '*' : '*' every type has the type '*' once normalized
+int is_sort_type (Context* ctx, Expr* type) {
+  if (type == NULL) return 0;
+  if (type->typ != EXP_KIND) type = nbe_normalize(ctx->arena, ctx->env, ctx->depth, type);
+  return type != NULL && type->typ == EXP_KIND;
+}
+
+int max (int lhs, int rhs) {
+  return lhs > rhs ? lhs : rhs;
+}
+
+typedef struct InferCall {
+  Context* ctx;
+  Expr* expr;
+  int* bound;
+  Expr* type;
+} InferCall;
+
+static void infer_deep (void* data) {
+  InferCall* call = data;
+  call->type = infer(call->ctx, call->expr, call->bound);
+}
+
+//  infers the type of 'expr' and sets 'bound' to one past its largest
+//  free index, which is what the cache needs to key the result on
+Expr* infer (Context* ctx, Expr* expr, int* bound) {
+  if (deep_low()) {
+    InferCall call = { ctx, expr, bound, NULL };
+    deep_run(infer_deep, &call);
+    return call.type;
+  }
+
+  *bound = 0;
+  STAT_INC(STAT_INFER_FREE + expr->typ);
+
   switch (expr->typ) {
     case EXP_KIND: 
-    case EXP_FREE: 
-    case EXP_TERM: return ctx_get(ctx, expr);
+      return ctx_get(ctx, expr);
+    case EXP_FREE: {
+      Expr* type = ctx_get(ctx, expr);
+      if (type) return type;
+      // a declaration that failed keeps its name but has no type
+      int known = ctx->arena->globals && globals_get(ctx->arena->globals, expr->name);
+      return fail(ctx, expr, known ? "refers to an ill-typed declaration" : "unknown name");
+    }
+    case EXP_TERM: 
+      *bound = expr->term.idx + 1;
+      return ctx_get(ctx, expr);
+    default: 
+      break;
+  }
+
+  if (ctx->cache) {
+    Expr* type = tcache_get(ctx->cache, expr, ctx_fingerprint, ctx);
+    if (type) return type;
+  }
+
+  STAT_ENTER(DEPTH_INFER);
+  Expr* type = infer_node(ctx, expr, bound);
+  STAT_LEAVE(DEPTH_INFER);
+  if (type && ctx->cache) {
+    tcache_put(ctx->cache, expr, *bound, ctx_fingerprint(ctx, *bound), type);
+  }
+  return type;
+}
+
+Expr* infer_node (Context* ctx, Expr* expr, int* bound) {
+  int lhs, rhs;
+
+  switch (expr->typ) {
     case EXP_LAM: {
-      Expr* annot = type_check(ctx, expr->lam.lhs->annot.ann);
-      if (annot == NULL) return NULL;
-      ctx_push(ctx, expr->lam.lhs, expr->lam.lhs->annot.ann);
-      Expr* body = type_check(ctx, expr->lam.rhs);
-      //ctx_rem(ctx, expr->lam.lhs);
+      Expr* annot = infer(ctx, expr->lam.lhs->term.ann, &lhs);
+      if (!is_sort_type(ctx, annot)) return fail(ctx, expr->lam.lhs->term.ann, "annotation is not a type");
+      ctx_bind(ctx, expr->lam.lhs);
+      Expr* body = infer(ctx, expr->lam.rhs, &rhs);
+      ctx_unbind(ctx);
       if (body == NULL) return NULL;
-      return ctx_push(ctx, expr, pi_new(expr->lam.lhs, body)); 
+      *bound = max(lhs, rhs - 1);
+      return pi_new(ctx->arena, expr->lam.lhs, body); 
     }
     case EXP_PI: {
-      Expr* annot = type_check(ctx, expr->lam.lhs->annot.ann);
-      if (!ctx_get(ctx, annot)) return NULL;
-      ctx_push(ctx, expr->pi.lhs, expr->lam.lhs->annot.ann);
-      Expr* body = type_check(ctx, expr->lam.rhs);
+      Expr* annot = infer(ctx, expr->pi.lhs->term.ann, &lhs);
+      if (!is_sort_type(ctx, annot)) return fail(ctx, expr->pi.lhs->term.ann, "annotation is not a type");
+      ctx_bind(ctx, expr->pi.lhs);
+      Expr* body = infer(ctx, expr->pi.rhs, &rhs);
+      ctx_unbind(ctx);
       if (body == NULL) return NULL;
-      //ctx_rem(ctx, expr->pi.lhs);
-      return ctx_push(ctx, expr, body);
+      // the sort of the codomain cannot mention the bound variable
+      if (occurs(body, 0)) return fail(ctx, expr, "sort of the codomain depends on the variable");
+      *bound = max(lhs, rhs - 1);
+      return shift(ctx->arena, body, -1, 0);
     }
-    case EXP_APP: {
-      Expr* type = type_check(ctx, expr->app.lhs);
-      if (type == NULL || type->typ != EXP_PI) return NULL;
-      Expr* rhs = type_check(ctx, expr->app.rhs);
-      if (!expr_eq(type->pi.lhs->annot.ann, rhs)) return NULL;
-
-      Expr* sub = subst(type->pi.rhs, type->pi.lhs, expr->app.rhs);
-      return ctx_push(ctx, expr, sub);
+    case EXP_SPINE: {
+      Expr* type = infer(ctx, expr->spine.nodes[0], &lhs);
+      if (type == NULL) return NULL;
+      *bound = lhs;
+
+      //  walks the telescope of 'type' without instantiating it, the
+      //  arguments from 'done' on are substituted into each domain and
+      //  the codomain at once. only a type that must be normalized to
+      //  expose its next Pi has the ones so far substituted in first
+      Expr** args = expr->spine.nodes + 1;
+      int len = expr->spine.len;
+      int done = 0;
+      for (int i = 0; i < len; i++) {
+        if (type->typ != EXP_PI) {
+          type = instantiate_many(ctx->arena, type, args + done, i - done);
+          type = nbe_normalize(ctx->arena, ctx->env, ctx->depth, type);
+          done = i;
+          if (type == NULL || type->typ != EXP_PI) return fail(ctx, args[i], "argument to a non-function");
+        }
+
+        // argument and domain need only be definitionally equal
+        Expr* dom = instantiate_many(ctx->arena, type->pi.lhs->term.ann, args + done, i - done);
+        Expr* arg = infer(ctx, args[i], &rhs);
+        if (arg == NULL) return NULL;
+        if (!nbe_conv(ctx->arena, ctx->env, ctx->depth, dom, arg)) return fail(ctx, args[i], "argument does not match the domain");
+
+        *bound = max(*bound, rhs);
+        type = type->pi.rhs;
+      }
+      return instantiate_many(ctx->arena, type, args + done, len - done);
     }
+    default:
+      return NULL;
   }
 }
 
+Expr* type_check (Context *ctx, Expr *expr) {
+  int bound;
+  return infer(ctx, expr, &bound);
+}
+
+//  a declared type must be a sort and a definition's value must have
+//  a type convertible to it, bare expressions only need a type.
+//  returns the declaration's type or NULL if it is ill-typed
+Expr* check_decl (Arena* arena, TypeCache* cache, Decl* decl) {
+  return check_decl_blame(arena, cache, decl, NULL);
+}
+
+Expr* check_decl_blame (Arena* arena, TypeCache* cache, Decl* decl, Blame* blame) {
+  STAT_START(start);
+  Context ctx;
+  ctx_init(&ctx, arena, cache);
+  ctx.blame = blame;
+  if (blame) blame->expr = NULL;
+
+  Expr* type = decl->type;
+  if (type && !is_sort_type(&ctx, type_check(&ctx, type))) type = fail(&ctx, type, "declared type is not a type");
+  else if (decl->value) {
+    Expr* infer = type_check(&ctx, decl->value);
+    if (infer == NULL) type = NULL;
+    else if (type == NULL) type = infer;
+    else if (!nbe_conv(arena, NULL, 0, type, infer)) type = fail(&ctx, decl->value, "value does not match the declared type");
+  }
 
+  ctx_free(&ctx);
+  STAT_STOP(TIME_CHECK, start);
+  return type;
+}
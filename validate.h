@@ -2,6 +2,7 @@
 #define __VALIDATE_H__
 
 #include "parser.h"
+#include "tcache.h"
 
 typedef struct Context Context;
 
@@ -19,15 +20,32 @@ typedef struct Sort {
 } Sort;
 
 void print_ctx(Context* ctx);
-Expr term (const char* tex);
+Expr term (Arena* arena, const char* tex);
 
 int expr_eq (Expr* lhs, Expr* rhs);
 
-int is_subterm (Expr* expr, Expr* term);
-Expr* subst (Expr* expr, Expr* term, Expr* sub);
-
-Expr* check (Expr* expr);
+int occurs (Expr* expr, int idx);
+Expr* shift (Arena* arena, Expr* expr, int by, int cutoff);
+Expr* subst (Arena* arena, Expr* expr, int idx, Expr* sub);
+Expr* subst_many (Arena* arena, Expr* expr, int idx, Expr** subs, int n);
+Expr* instantiate (Arena* arena, Expr* body, Expr* arg);
+Expr* instantiate_many (Arena* arena, Expr* body, Expr** args, int n);
+
+//  where a failed check gave up and why. the innermost failure is kept,
+//  those of the nodes around it follow from it
+typedef struct Blame {
+  Expr* expr;
+  const char* why;
+} Blame;
+
+Expr* check (Arena* arena, Expr* expr);
+Expr* check_with (Arena* arena, TypeCache* cache, Expr* expr);
+Expr* check_decl (Arena* arena, TypeCache* cache, Decl* decl);
+// as check_decl, filling in 'blame' when it fails
+Expr* check_decl_blame (Arena* arena, TypeCache* cache, Decl* decl, Blame* blame);
 Expr* type_check (Context* ctx, Expr* expr);
+Expr* infer (Context* ctx, Expr* expr, int* bound);
+Expr* infer_node (Context* ctx, Expr* expr, int* bound);
 
 
 
@@ -12,16 +12,26 @@ void* vec_new (int size, int cap) {
 
 void* vec_fit (void* buf, int size) {
   if (VEC_LEN(buf) >= VEC_CAP(buf)) {
-    buf = vec_realloc(buf, size, 2 * VEC_CAP(buf));
+    buf = vec_realloc(buf, size, VEC_CAP(buf) ? 2 * VEC_CAP(buf) : 8);
   }
   return buf;
 }
 
+// returns the slot past the end, growing the buffer behind '*buf' if needed
+void* vec_push (void** buf, int size) {
+  *buf = vec_fit(*buf, size);
+  return (char*)*buf + size * VEC_LEN(*buf)++;
+}
+
+void* vec_reserve (void* buf, int size, int cap) {
+  if (cap <= VEC_CAP(buf)) return buf;
+  return vec_realloc(buf, size, cap);
+}
+
 void vec_rem (void* buf, int size, int idx) {
-  VEC_LEN(buf)--;
-  for (int i = idx; i < VEC_LEN(buf)-1; i++) {
-    memcpy(buf, buf+size, size);
-  }
+  int len = --VEC_LEN(buf);
+  char* at = (char*)buf + idx * size;
+  memmove(at, at + size, (len - idx) * size);
 }
 
 void* vec_realloc (void* buf, int size, int cap) {
@@ -30,6 +40,15 @@ void* vec_realloc (void* buf, int size, int cap) {
   return (void*)(ptr + 2);
 }
 
+void* vec_grow (void* data, int len, int cap, size_t size, void* small) {
+  if (data && data == small) {
+    void* heap = malloc(cap * size);
+    memcpy(heap, data, len * size);
+    return heap;
+  }
+  return realloc(data, cap * size);
+}
+
 
 
 
@@ -43,7 +62,7 @@ char *str_new (char *src) {
 char *str_cpy (char *dest, const char *src) {
   int len = strlen(src);
   if (VEC_CAP(dest) < len) {
-    dest = vec_realloc((void**)&dest, 1, len + 1);
+    dest = vec_realloc(dest, 1, len + 1);
   }
   return strcpy(dest, src);
 }
@@ -51,7 +70,7 @@ char *str_cpy (char *dest, const char *src) {
 char *str_cat (char *dest, const char *src) {
   int len = strlen(src);
   if (VEC_CAP(dest) < len + VEC_LEN(dest)) {
-    dest = vec_realloc((void**)&dest, 1, len + VEC_LEN(dest) + 1);
+    dest = vec_realloc(dest, 1, len + VEC_LEN(dest) + 1);
   }
   return strcat(dest, src);
 }
@@ -1,6 +1,9 @@
 #ifndef _VEC_H_
 #define _VEC_H_
 
+#include <stdlib.h>
+#include <string.h>
+
 #define VEC(T) T*
 
 //  _____________________
@@ -9,19 +12,21 @@
 // |  1   |  cap         |
 // |  2   |  len         |
 // |  3   |  1st element | <- array points here
-// |  n   |  nth element | <- NOTE: nth byte depends on array size 
+// |  n   |  nth element | <- NOTE: nth byte depends on array size
 //  ---------------------
 
 #define VEC_NEW(T, N)  (T*)vec_new(sizeof(T), N)
-#define VEC_PUSH(V, E) V = vec_fit((void*)V, sizeof(V[0])); V[VEC_LEN(V)++] = E
-#define VEC_POP(V)     VEC_REM(V, VEC_LEN(V) - 1)
-#define VEC_REM(V, I)  vec_rem(V, sizeof(V[0]), I)
+#define VEC_PUSH(V, E) (*(__typeof__(*(V))*)vec_push((void**)&(V), sizeof(*(V))) = (E))
+#define VEC_POP(V)     ((V)[--VEC_LEN(V)])
+#define VEC_REM(V, I)  vec_rem(V, sizeof(*(V)), I)
+#define VEC_SWAP_REM(V, I) ((V)[I] = (V)[--VEC_LEN(V)])
+#define VEC_RESERVE(V, N)  ((V) = vec_reserve(V, sizeof(*(V)), N))
 #define VEC_FREE(V)    free(VEC_LOC(V))
 
-#define VEC_LEN(V)  ((int*)V)[-1]
-#define VEC_CAP(V)  ((int*)V)[-2]
-#define VEC_LOC(V)  &((int*)V)[-2]
-#define VEC_LAST(V) V[VEC_LEN(V)-1]
+#define VEC_LEN(V)  (((int*)(V))[-1])
+#define VEC_CAP(V)  (((int*)(V))[-2])
+#define VEC_LOC(V)  (&((int*)(V))[-2])
+#define VEC_LAST(V) ((V)[VEC_LEN(V)-1])
 
 #define STR_NEW(dest, src) dest = str_new(s)
 #define STR_CPY(dest, src) dest = str_cpy(dest, src)
@@ -29,10 +34,77 @@
 
 void* vec_new     (int size, int cap);
 void* vec_fit     (void* buf, int size);
+void* vec_push    (void** buf, int size);
+void* vec_reserve (void* buf, int size, int cap);
 void* vec_realloc (void* buf, int size, int cap);
 
 void vec_rem (void* buf, int size, int idx);
 
+// moves 'data' out of an inline buffer or reallocates it to 'cap'
+void* vec_grow (void* data, int len, int cap, size_t size, void* small);
+
+//  per-type vectors with the element size known at compile time,
+//  VEC_DEFINE(ExprVec, Expr*) declares 'ExprVec' along with
+//  ExprVec_init, ExprVec_push, ExprVec_pop, ...
+#define VEC_DEFINE(N, T)                                  \
+  typedef struct N { T* data; int len; int cap; } N;      \
+  static inline void N##_init (N* v, int cap) {           \
+    v->data = cap ? (T*)malloc(cap * sizeof(T)) : NULL;   \
+    v->len = 0;                                           \
+    v->cap = cap;                                         \
+  }                                                       \
+  VEC_IMPL(N, T, NULL)
+
+//  small-buffer variant, the first K elements live inside the struct
+//  and 'data' points at them until it outgrows them, so the struct
+//  must be initialized in place and never copied by value
+#define SVEC_DEFINE(N, T, K)                                       \
+  typedef struct N { T* data; int len; int cap; T small[K]; } N;   \
+  static inline void N##_init (N* v) {                             \
+    v->data = v->small;                                            \
+    v->len = 0;                                                    \
+    v->cap = K;                                                    \
+  }                                                                \
+  VEC_IMPL(N, T, v->small)
+
+#define VEC_IMPL(N, T, SMALL)                                                 \
+  static inline void N##_free (N* v) {                                        \
+    if (v->data != SMALL) free(v->data);                                      \
+  }                                                                           \
+  static inline void N##_reserve (N* v, int cap) {                            \
+    if (cap <= v->cap) return;                                                \
+    int next = v->cap ? 2 * v->cap : 8;                                       \
+    while (next < cap) next *= 2;                                             \
+    v->data = (T*)vec_grow(v->data, v->len, next, sizeof(T), SMALL);          \
+    v->cap = next;                                                            \
+  }                                                                           \
+  static inline void N##_push (N* v, T elem) {                                \
+    if (v->len == v->cap) N##_reserve(v, v->len + 1);                         \
+    v->data[v->len++] = elem;                                                 \
+  }                                                                           \
+  static inline T N##_pop (N* v) {                                            \
+    return v->data[--v->len];                                                 \
+  }                                                                           \
+  static inline void N##_extend (N* v, const T* src, int n) {                 \
+    N##_reserve(v, v->len + n);                                               \
+    memcpy(v->data + v->len, src, n * sizeof(T));                             \
+    v->len += n;                                                              \
+  }                                                                           \
+  static inline T N##_swap_rem (N* v, int idx) {                              \
+    T elem = v->data[idx];                                                    \
+    v->data[idx] = v->data[--v->len];                                         \
+    return elem;                                                              \
+  }                                                                           \
+  static inline T N##_rem (N* v, int idx) {                                   \
+    T elem = v->data[idx];                                                    \
+    v->len--;                                                                 \
+    memmove(v->data + idx, v->data + idx + 1, (v->len - idx) * sizeof(T));    \
+    return elem;                                                              \
+  }                                                                           \
+  static inline void N##_clear (N* v) {                                       \
+    v->len = 0;                                                               \
+  }
+
 char* str_new (char* src);
 char* str_cat (char* dest, const char* src);
 char* str_cpy (char* dest, const char* src);